@@ -1,5 +1,11 @@
 #! /bin/bash
 
+gcc -c playlist.c -o playlist.o `pkg-config --cflags libcurl`
 gcc -c main.c -o player.o `pkg-config --cflags gtk+-3.0 libvlc`
-gcc player.o -o player `pkg-config --libs gtk+-3.0 libcurl libvlc` -export-dynamic
-rm player.o
+gcc player.o playlist.o -o player `pkg-config --libs gtk+-3.0 libcurl libvlc` -export-dynamic
+
+# headless benchmark of the playlist code
+gcc -O2 tools/m3u_bench.c playlist.o -o m3u_bench -pthread `pkg-config --libs libcurl` -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+
+# fuzzer (needs clang): clang -g -O1 -fsanitize=fuzzer,address tools/m3u_fuzz.c playlist.c -o m3u_fuzz -pthread `pkg-config --libs libcurl`
+rm player.o playlist.o
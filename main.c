@@ -19,6 +19,8 @@
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <libgen.h>
@@ -28,607 +30,5295 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <vlc/vlc.h>    // sudo apt install libvlc-dev
 #include <ctype.h>
+#include <strings.h>
+#include <dirent.h>
+#include "playlist.h"
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib-unix.h>
+#include <signal.h>
 //#include <X11/Xlib.h>   // sudo apt install libx11-dev
 
 // =====================================
-// PLAYLIST
+// TRACE
 // =====================================
 
-typedef struct playlist_entry {
-    char* url;
-    char* name;
-    char* logo;
-    void* private_data;
-} playlist_entry_t;
+// set M3U_PLAYER_TRACE to time the main steps: any value prints a summary on exit, and a
+// name ending in .json also writes the events there, to be opened in chrome://tracing or Perfetto
+// when it is not set, each measure costs only the test of 'trace_enabled'
+typedef struct trace_event {
+    const char* name;   // static string
+    uint32_t tid;
+    int64_t start;      // us, monotonic
+    int64_t duration;
+} trace_event_t;
+
+int trace_enabled;
+static const char* trace_file;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_event_t* trace_events;
+static uint32_t trace_num_events;
+static uint32_t trace_max_events;
+static int64_t trace_origin;
+
+#define TRACE_MAX_EVENTS (1u << 20)
+
+#define TRACE_BEGIN(var)        int64_t var = trace_enabled ? trace_now() : 0
+#define TRACE_END(name, var)    do { if (trace_enabled) trace_complete(name, var, trace_now()); } while (0)
+
+int64_t trace_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t trace_thread_id()
+{
+    static uint32_t next_tid;
+    static __thread uint32_t tid;
 
-typedef struct playlist_group {
-    char* group_name;
-    uint16_t num_entries;
-    playlist_entry_t* entries;
-} playlist_group_t;
+    if (tid == 0)
+        tid = __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
 
-typedef struct playlist {
-    uint8_t num_groups;
-    playlist_group_t* groups;
-} playlist_t;
+    return tid;
+}
 
-playlist_group_t* playlist_find_group(playlist_t* playlist, const char* group_name)
+void trace_init()
 {
-    if (playlist == NULL || group_name == NULL) // sanity check
-        return NULL;
+    const char* value = getenv("M3U_PLAYER_TRACE");
+
+    if (value == NULL || value[0] == '\0')
+        return;
 
-    for (uint8_t g = 0; g < playlist->num_groups; g++)
-        if (strcmp(playlist->groups[g].group_name, group_name) == 0)
-            return &playlist->groups[g];
+    size_t len = strlen(value);
+    if (len > 5 && strcmp(value + len - 5, ".json") == 0)
+        trace_file = value;
 
-    return NULL;
+    trace_origin = trace_now();
+    trace_enabled = 1;
+}
+
+void trace_complete(const char* name, int64_t start, int64_t end)
+{
+    pthread_mutex_lock(&trace_lock);
+
+    if (trace_num_events == trace_max_events && trace_max_events < TRACE_MAX_EVENTS)
+    {
+        uint32_t new_max = (trace_max_events == 0) ? 1024 : trace_max_events * 2;
+        trace_event_t* grown = (trace_event_t*)realloc(trace_events, new_max * sizeof(trace_event_t));
+
+        if (grown != NULL)
+        {
+            trace_events = grown;
+            trace_max_events = new_max;
+        }
+    }
+
+    if (trace_num_events < trace_max_events)
+        trace_events[trace_num_events++] = (trace_event_t) {
+            .name = name,
+            .tid = trace_thread_id(),
+            .start = start,
+            .duration = end - start,
+        };
+
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_write_json()
+{
+    FILE* fp = fopen(trace_file, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "\nCannot write trace to %s: %s\n", trace_file, strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+
+    for (uint32_t e = 0; e < trace_num_events; e++)
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld}\n", (e == 0) ? "" : ",",
+                trace_events[e].name, trace_events[e].tid, (long long)(trace_events[e].start - trace_origin), (long long)trace_events[e].duration);
+
+    fprintf(fp, "]}\n");
+    fclose(fp);
+
+    printf("\nTrace written to %s\n", trace_file);
+}
+
+// count, total, mean and longest time of each step
+static void trace_print_summary()
+{
+    uint8_t* done = (uint8_t*)calloc(trace_num_events + 1, 1);
+    if (done == NULL)
+        return;
+
+    fprintf(stderr, "\n%-24s %8s %12s %10s %10s\n", "trace", "count", "total ms", "mean ms", "max ms");
+
+    for (uint32_t e = 0; e < trace_num_events; e++)
+    {
+        if (done[e])
+            continue;
+
+        uint32_t count = 0;
+        int64_t total = 0, longest = 0;
+
+        for (uint32_t o = e; o < trace_num_events; o++)
+        {
+            if (done[o] || strcmp(trace_events[o].name, trace_events[e].name) != 0)
+                continue;
+
+            done[o] = 1;
+            count++;
+            total += trace_events[o].duration;
+
+            if (trace_events[o].duration > longest)
+                longest = trace_events[o].duration;
+        }
+
+        fprintf(stderr, "%-24s %8u %12.3f %10.3f %10.3f\n", trace_events[e].name, count, total / 1000.0, total / 1000.0 / count, longest / 1000.0);
+    }
+
+    free(done);
+}
+
+void trace_finish()
+{
+    if (!trace_enabled)
+        return;
+
+    pthread_mutex_lock(&trace_lock);
+
+    trace_print_summary();
+
+    if (trace_file != NULL)
+        trace_write_json();
+
+    free(trace_events);
+    trace_events = NULL;
+    trace_num_events = trace_max_events = 0;
+
+    pthread_mutex_unlock(&trace_lock);
 }
 
-playlist_group_t* playlist_new_group(playlist_t* playlist, const char* group_name)
+// =====================================
+// LOGO DOWNLOAD
+// =====================================
+#define LOGO_SIZE       80                  // logos are shown as LOGO_SIZE x LOGO_SIZE
+#define LOGO_MAX_BYTES  (4*1024*1024)       // larger downloads are not logos
+
+// decodes an image file (PNG, JPEG...) held in memory and scales it to the logo size
+GdkPixbuf* pixbuff_from_data(const uint8_t* data, size_t len)
 {
-    if (playlist == NULL || group_name == NULL) // sanity check
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    if (loader == NULL)
+    {
+        fprintf(stderr, "\nCould not create 'GdkPixbufLoader'\n");
         return NULL;
+    }
 
-    // alloc space for new group struct in the playlist
-    playlist_group_t* new_list = (playlist_group_t*)realloc(playlist->groups, sizeof(playlist_group_t)*(playlist->num_groups + 1));
-    if (new_list == NULL)
+    // the whole file is handed over at once
+    if (!gdk_pixbuf_loader_write(loader, data, len, NULL) || !gdk_pixbuf_loader_close(loader, NULL))
+    {
+        fprintf(stderr, "\ngdk_pixbuf_loader_write failed\n");
+        g_object_unref(loader);
         return NULL;
-    else
-        playlist->groups = new_list;
+    }
+
+    GdkPixbuf* pxb_1 = gdk_pixbuf_loader_get_pixbuf(loader); // owned by the loader
 
-    // setup group
-    playlist_group_t* new_group = &playlist->groups[playlist->num_groups++];
-    new_group->num_entries = 0;
-    new_group->entries = NULL;
-    new_group->group_name = malloc(strlen(group_name) + 1);
-    strcpy(new_group->group_name, group_name);
+    if (pxb_1 == NULL)
+    {
+        fprintf(stderr, "\ngdk_pixbuf_loader_get_pixbuf failed\n");
+        g_object_unref(loader);
+        return NULL;
+    }
+
+    GdkPixbuf* pxb_2 = gdk_pixbuf_scale_simple(pxb_1, LOGO_SIZE, LOGO_SIZE, GDK_INTERP_BILINEAR);
 
-    return new_group;
+    g_object_unref(loader);
+
+    return pxb_2;
 }
 
-playlist_entry_t* group_new_entry(playlist_group_t* g, const char* name, const char* logo, const char* url)
+// the cache keeps the logos already scaled, as raw pixels preceded by this header
+#define LOGO_THUMB_MAGIC 0x314d4854 // "THM1"
+
+typedef struct logo_thumb_header {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowstride;
+    uint32_t has_alpha;
+} logo_thumb_header_t;
+
+// reads the whole cached file at once - old caches holding the original image are decoded and scaled
+GdkPixbuf* logo_thumb_load(const char* file_name, int* is_thumb)
 {
-    if (g == NULL || name == NULL  || logo == NULL || url == NULL) // sanity check
+    int fd;
+    if ((fd = open(file_name, O_RDONLY)) == -1)
         return NULL;
 
-    // allocate space in list for new entry
-    playlist_entry_t* new_pl = (playlist_entry_t*)realloc(g->entries, (g->num_entries + 1)*sizeof(playlist_entry_t));
-    if (new_pl == NULL) // could not reallocate
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > LOGO_MAX_BYTES)
+    {
+        close(fd);
         return NULL;
-    else
-        g->entries = new_pl;
+    }
+
+    uint8_t* data = (uint8_t*)g_malloc(st.st_size);
+    ssize_t len = read(fd, data, st.st_size);
+    close(fd);
+
+    if (len != st.st_size)
+    {
+        g_free(data);
+        return NULL;
+    }
+
+    logo_thumb_header_t header;
+    *is_thumb = 0;
+
+    if ((size_t)len > sizeof(header))
+    {
+        memcpy(&header, data, sizeof(header));
+
+        if (header.magic == LOGO_THUMB_MAGIC && header.width <= LOGO_SIZE * 4 && header.height <= LOGO_SIZE * 4
+            && header.rowstride >= header.width * (header.has_alpha ? 4 : 3)
+            && (uint64_t)header.rowstride * header.height == len - sizeof(header))
+        {
+            // pixels are used in place after the header
+            GBytes* bytes = g_bytes_new_take(data, len);
+            GBytes* pixels = g_bytes_new_from_bytes(bytes, sizeof(header), len - sizeof(header));
+            g_bytes_unref(bytes);
+
+            GdkPixbuf* pixbuf = gdk_pixbuf_new_from_bytes(pixels, GDK_COLORSPACE_RGB, header.has_alpha != 0, 8,
+                                                          header.width, header.height, header.rowstride);
+            g_bytes_unref(pixels);
 
-    playlist_entry_t* new_entry = &g->entries[g->num_entries++];
+            *is_thumb = 1;
+            return pixbuf;
+        }
+    }
 
-    // alloc space for the content
-    uint16_t len_name, len_logo, len_url;
+    GdkPixbuf* pixbuf = pixbuff_from_data(data, len);
+    g_free(data);
+
+    return pixbuf;
+}
 
-    *new_entry = (playlist_entry_t) {
-        .name  = malloc( (len_name =  strlen(name) + 1) ),
-        .logo  = malloc( (len_logo =  strlen(logo) + 1) ),
-        .url   = malloc( (len_url =   strlen(url) + 1) ),
-        .private_data = NULL,
+// writes the scaled logo to a temporary file and renames it into place
+int logo_thumb_save(const char* key, const char* file_name, GdkPixbuf* pixbuf)
+{
+    static gint temp_counter;
+    char dir_name[64], temp_name[256];
+
+    snprintf(dir_name, sizeof(dir_name), "%s/logos", cache_dir);
+    mkdir(cache_dir, 0777); // may already exist
+    mkdir(dir_name, 0777);
+    snprintf(dir_name, sizeof(dir_name), "%s/logos/%.2s", cache_dir, key);
+    mkdir(dir_name, 0777);
+
+    snprintf(temp_name, sizeof(temp_name), "%s.%d.%d", file_name, (int)getpid(), g_atomic_int_add(&temp_counter, 1));
+
+    // rows are stored without the padding of the pixbuf
+    logo_thumb_header_t header = {
+        .magic = LOGO_THUMB_MAGIC,
+        .width = gdk_pixbuf_get_width(pixbuf),
+        .height = gdk_pixbuf_get_height(pixbuf),
+        .rowstride = gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_n_channels(pixbuf),
+        .has_alpha = gdk_pixbuf_get_has_alpha(pixbuf),
     };
 
-    // copy the content from temp buffer to inside the (permanente) new list entry
-    memcpy(new_entry->name,  name,  len_name);
-    memcpy(new_entry->logo,  logo,  len_logo);
-    memcpy(new_entry->url,   url,   len_url);
+    const uint8_t* pixels = gdk_pixbuf_read_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+
+    FILE* fp;
+    if ((fp = fopen(temp_name, "wb")) == NULL)
+        return 0;
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    for (uint32_t y = 0; ok && y < header.height; y++)
+        ok = fwrite(pixels + (size_t)y * rowstride, header.rowstride, 1, fp) == 1;
+
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(temp_name, file_name) != 0)
+    {
+        remove(temp_name);
+        return 0;
+    }
+
+    return 1;
+}
+
+// logos are stored as cache/logos/<first two digits of the key>/<key>, where the key is the SHA-256 of the url
+// next to each one, <key>.meta tells when it was downloaded and how to revalidate it
+#define LOGO_KEY_LEN 64
+
+int logo_ttl_hours = 168;   // age after which a cached logo is revalidated with the server (--logo-ttl)
+int logo_disk_mb = 256;     // size of the logos on disk, the least recently used are removed beyond it (--logo-disk-mb)
+
+// logo on disk
+typedef struct logo_disk_entry {
+    char key[LOGO_KEY_LEN + 1];  // also the key of the entry in 'logo_index'
+    uint32_t bytes;     // thumbnail and metadata
+    int64_t used;       // last time it was loaded (or written)
+} logo_disk_entry_t;
+
+static GMutex logo_index_lock;
+static GHashTable* logo_index;  // logo_disk_entry_t of the logos on disk - avoids hitting the file system to check them
+static uint64_t logo_disk_bytes;
+
+void logo_cache_path(const char* key, char* path, size_t max_len)
+{
+    snprintf(path, max_len, "%s/logos/%.2s/%s", cache_dir, key, key);
+}
+
+void logo_meta_path(const char* key, char* path, size_t max_len)
+{
+    snprintf(path, max_len, "%s/logos/%.2s/%s.meta", cache_dir, key, key);
+}
+
+// when the logo was downloaded and the validators the server sent with it
+#define LOGO_META_MAGIC 0x3154454d // "MET1"
+
+typedef struct logo_meta {
+    uint32_t magic;
+    int64_t fetched;        // last download or revalidation (seconds since the epoch)
+    char etag[128];         // empty if the server sent none
+    char last_modified[64];
+} logo_meta_t;
+
+int logo_meta_load(const char* key, logo_meta_t* meta)
+{
+    char file_name[256];
+    logo_meta_path(key, file_name, sizeof(file_name));
+
+    FILE* fp;
+    if ((fp = fopen(file_name, "rb")) == NULL)
+        return 0;
+
+    int ok = fread(meta, sizeof(logo_meta_t), 1, fp) == 1 && meta->magic == LOGO_META_MAGIC;
+    fclose(fp);
+
+    // validators are sent back to the server as they are
+    meta->etag[sizeof(meta->etag) - 1] = '\0';
+    meta->last_modified[sizeof(meta->last_modified) - 1] = '\0';
+
+    return ok;
+}
+
+int logo_meta_save(const char* key, const logo_meta_t* meta)
+{
+    static gint temp_counter;
+    char file_name[256], temp_name[256];
+
+    logo_meta_path(key, file_name, sizeof(file_name));
+    snprintf(temp_name, sizeof(temp_name), "%s.%d.%d", file_name, (int)getpid(), g_atomic_int_add(&temp_counter, 1));
+
+    FILE* fp;
+    if ((fp = fopen(temp_name, "wb")) == NULL)
+        return 0;
+
+    int ok = fwrite(meta, sizeof(logo_meta_t), 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(temp_name, file_name) != 0)
+    {
+        remove(temp_name);
+        return 0;
+    }
+
+    return 1;
+}
+
+// lists the logos already on disk - called once, by the first thread which needs the index
+void logo_index_build()
+{
+    char dir_name[64];
+    char file_name[256];
+
+    logo_index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+    for (unsigned shard = 0; shard < 256; shard++)
+    {
+        snprintf(dir_name, sizeof(dir_name), "%s/logos/%02x", cache_dir, shard);
+
+        DIR* dir;
+        if ((dir = opendir(dir_name)) == NULL)
+            continue;
+
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != NULL)
+        {
+            if (strlen(ent->d_name) != LOGO_KEY_LEN) // skips '.', '..', metadata and temporary files
+                continue;
+
+            struct stat st;
+            snprintf(file_name, sizeof(file_name), "%s/%s", dir_name, ent->d_name);
+
+            if (stat(file_name, &st) != 0)
+                continue;
+
+            logo_disk_entry_t* entry = g_new(logo_disk_entry_t, 1);
+            strcpy(entry->key, ent->d_name);
+            entry->bytes = st.st_size + sizeof(logo_meta_t);
+            entry->used = st.st_mtime;
+
+            g_hash_table_insert(logo_index, entry->key, entry);
+            logo_disk_bytes += entry->bytes;
+        }
+
+        closedir(dir);
+    }
+
+    printf("\n%u logos in cache (%lu KB)\n", g_hash_table_size(logo_index), (unsigned long)(logo_disk_bytes / 1024));
+}
+
+// also marks the logo as used, so it is not the next to be evicted
+int logo_index_contains(const char* key)
+{
+    g_mutex_lock(&logo_index_lock);
+
+    if (logo_index == NULL)
+        logo_index_build();
+
+    logo_disk_entry_t* entry = (logo_disk_entry_t*)g_hash_table_lookup(logo_index, key);
+    if (entry != NULL)
+        entry->used = time(NULL);
+
+    g_mutex_unlock(&logo_index_lock);
+
+    return entry != NULL;
+}
+
+gint logo_disk_compare_used(gconstpointer a, gconstpointer b, gpointer user)
+{
+    const logo_disk_entry_t* entry_a = *(logo_disk_entry_t* const*)a;
+    const logo_disk_entry_t* entry_b = *(logo_disk_entry_t* const*)b;
+
+    return (entry_a->used > entry_b->used) - (entry_a->used < entry_b->used);
+}
+
+// total once an entry changes from 'old_bytes' to 'new_bytes' (0 when removed) - computed in 64 bits,
+// so an entry shrinking on revalidation does not wrap around
+uint64_t logo_disk_resize(uint64_t total, uint32_t old_bytes, uint32_t new_bytes)
+{
+    if (total < old_bytes) // the entries were not all counted: never expected
+    {
+        fprintf(stderr, "\nLogo cache size out of sync: %" PRIu64 " bytes, entry of %u\n", total, old_bytes);
+        total = old_bytes;
+    }
+
+    return total - old_bytes + new_bytes;
+}
+
+// removes the least recently used logos until the cache is 10% below its limit (must hold 'logo_index_lock')
+void logo_disk_evict()
+{
+    uint64_t limit = (uint64_t)logo_disk_mb * 1024 * 1024;
+
+    if (logo_disk_mb <= 0 || logo_disk_bytes <= limit)
+        return;
+
+    guint count = g_hash_table_size(logo_index);
+    logo_disk_entry_t** entries = g_new(logo_disk_entry_t*, count);
+
+    GHashTableIter iter;
+    gpointer value;
+    guint n = 0;
+
+    g_hash_table_iter_init(&iter, logo_index);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        entries[n++] = (logo_disk_entry_t*)value;
+
+    g_qsort_with_data(entries, count, sizeof(logo_disk_entry_t*), logo_disk_compare_used, NULL);
+
+    char file_name[256];
+    uint64_t target = limit / 10 * 9;
+    guint evicted;
+
+    for (evicted = 0; evicted < count && logo_disk_bytes > target; evicted++)
+    {
+        logo_disk_entry_t* entry = entries[evicted];
+
+        logo_cache_path(entry->key, file_name, sizeof(file_name));
+        remove(file_name);
+        logo_meta_path(entry->key, file_name, sizeof(file_name));
+        remove(file_name);
+
+        logo_disk_bytes = logo_disk_resize(logo_disk_bytes, entry->bytes, 0);
+        g_hash_table_remove(logo_index, entry->key); // releases the entry
+    }
+
+    printf("\n%u logos removed from the disk cache\n", evicted);
+    g_free(entries);
+}
+
+void logo_index_add(const char* key, uint32_t bytes)
+{
+    g_mutex_lock(&logo_index_lock);
+
+    logo_disk_entry_t* entry = (logo_disk_entry_t*)g_hash_table_lookup(logo_index, key);
+
+    if (entry == NULL)
+    {
+        entry = g_new0(logo_disk_entry_t, 1);
+        g_strlcpy(entry->key, key, sizeof(entry->key));
+        g_hash_table_insert(logo_index, entry->key, entry);
+    }
+
+    logo_disk_bytes = logo_disk_resize(logo_disk_bytes, entry->bytes, bytes);
+    entry->bytes = bytes;
+    entry->used = time(NULL);
+
+    logo_disk_evict();
+    g_mutex_unlock(&logo_index_lock);
+}
+
+void logo_index_remove(const char* key)
+{
+    g_mutex_lock(&logo_index_lock);
+
+    logo_disk_entry_t* entry = (logo_disk_entry_t*)g_hash_table_lookup(logo_index, key);
+    if (entry != NULL)
+    {
+        logo_disk_bytes = logo_disk_resize(logo_disk_bytes, entry->bytes, 0);
+        g_hash_table_remove(logo_index, key);
+    }
+
+    g_mutex_unlock(&logo_index_lock);
+}
+
+size_t logo_curl_write(char* data, size_t size, size_t nmemb, void* user)
+{
+    GByteArray* buffer = (GByteArray*)user;
+
+    if (buffer->len + size * nmemb > LOGO_MAX_BYTES)
+        return 0; // abort the transfer
+
+    g_byte_array_append(buffer, (const guint8*)data, size * nmemb);
+    return size * nmemb;
+}
+
+size_t logo_curl_header(char* data, size_t size, size_t nmemb, void* user)
+{
+    logo_meta_t* meta = (logo_meta_t*)user;
+    size_t len = size * nmemb;
+
+    char* field = NULL;
+    size_t max_len = 0;
+    const char* value = data;
+
+    if (len > 5 && strncasecmp(data, "ETag:", 5) == 0)
+        field = meta->etag, max_len = sizeof(meta->etag), value += 5;
+    else if (len > 14 && strncasecmp(data, "Last-Modified:", 14) == 0)
+        field = meta->last_modified, max_len = sizeof(meta->last_modified), value += 14;
+
+    if (field != NULL)
+    {
+        const char* end = data + len;
+
+        while (value < end && (*value == ' ' || *value == '\t'))
+            value++;
+        while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' '))
+            end--;
+
+        if ((size_t)(end - value) < max_len)
+        {
+            memcpy(field, value, end - value);
+            field[end - value] = '\0';
+        }
+    }
+
+    return len;
+}
+
+// most logos come from a few servers: the workers share DNS answers and TLS sessions, and each keeps
+// its connections open in its own handle (a shared connection cache made libcurl 7.88 reconnect instead)
+static CURLSH* logo_share;
+static GMutex logo_share_locks[CURL_LOCK_DATA_LAST];
+
+void logo_share_lock(CURL* curl, curl_lock_data data, curl_lock_access access, void* user)
+{
+    g_mutex_lock(&logo_share_locks[data]);
+}
+
+void logo_share_unlock(CURL* curl, curl_lock_data data, void* user)
+{
+    g_mutex_unlock(&logo_share_locks[data]);
+}
+
+void logo_share_init()
+{
+    if ((logo_share = curl_share_init()) == NULL)
+        return; // each worker resolves on its own
+
+    curl_share_setopt(logo_share, CURLSHOPT_LOCKFUNC, logo_share_lock);
+    curl_share_setopt(logo_share, CURLSHOPT_UNLOCKFUNC, logo_share_unlock);
+    curl_share_setopt(logo_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(logo_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+// handle of one worker - kept for all its downloads, so the connections stay open between logos
+CURL* logo_curl_new()
+{
+    CURL* curl = curl_easy_init();
+    if (curl == NULL)
+        return NULL;
+
+    curl_easy_setopt(curl, CURLOPT_SHARE, logo_share);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS); // HTTP/2 if the server speaks it over TLS
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, http_user_agent);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L); // do not decode error pages
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, logo_curl_write);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, logo_curl_header);
+
+    return curl;
+}
+
+// downloads the original image to memory and returns it decoded and scaled - 'meta' is updated on success
+// if the server answers the cached logo is still current, NULL is returned and 'not_modified' is set
+GdkPixbuf* logo_download(CURL* curl, const char* url, logo_meta_t* meta, int* not_modified)
+{
+    *not_modified = 0;
+
+    if (curl == NULL)
+        return NULL; // cannot download
+
+    GByteArray* buffer = g_byte_array_new();
+    logo_meta_t received = { .magic = LOGO_META_MAGIC };
+
+    // revalidation: the server answers 304 without the image when it did not change
+    struct curl_slist* headers = NULL;
+    char header[sizeof(meta->etag) + 32];
+
+    if (meta->etag[0] != '\0')
+    {
+        snprintf(header, sizeof(header), "If-None-Match: %s", meta->etag);
+        headers = curl_slist_append(headers, header);
+    }
 
-    return new_entry;
+    if (meta->last_modified[0] != '\0')
+    {
+        snprintf(header, sizeof(header), "If-Modified-Since: %s", meta->last_modified);
+        headers = curl_slist_append(headers, header);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    TRACE_BEGIN(start);
+    CURLcode result = curl_easy_perform(curl);
+    TRACE_END("logo_download", start);
+
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL); // the handle is reused for other logos
+    curl_slist_free_all(headers);
+
+    GdkPixbuf* pixbuf = NULL;
+
+    if (result != CURLE_OK)
+        fprintf(stderr, "\nCurl failed to download '%s': %s\n", url, curl_easy_strerror(result));
+    else if (status == 304)
+    {
+        *not_modified = 1;
+        meta->fetched = time(NULL);
+    }
+    else
+    {
+        TRACE_BEGIN(decode);
+        pixbuf = pixbuff_from_data(buffer->data, buffer->len);
+        TRACE_END("logo_decode", decode);
+
+        if (pixbuf != NULL)
+        {
+            received.fetched = time(NULL);
+            *meta = received;
+        }
+    }
+
+    g_byte_array_free(buffer, TRUE);
+    return pixbuf;
+}
+
+// keeps the scaled version, so next time there is nothing to decode
+void logo_store(const char* key, const char* file_name, GdkPixbuf* pixbuf, const logo_meta_t* meta)
+{
+    struct stat st;
+
+    if (!logo_thumb_save(key, file_name, pixbuf) || stat(file_name, &st) != 0)
+    {
+        fprintf(stderr, "\nFailed to save logo '%s': %d %s\n", file_name, errno, strerror(errno));
+        return;
+    }
+
+    logo_meta_save(key, meta);
+    logo_index_add(key, st.st_size + sizeof(logo_meta_t));
+}
+
+// returns the scaled logo from the cache, or downloads it and stores the thumbnail in the cache
+// 'stale' is set when the cached logo is older than the TTL and should be revalidated
+GdkPixbuf* cache_or_download_logo(CURL* curl, const char* url, int* stale)
+{
+    char* key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, url, -1);
+    char file_name[256];
+    GdkPixbuf* pixbuf = NULL;
+    int is_thumb = 0;
+    logo_meta_t meta = { .magic = LOGO_META_MAGIC };
+
+    logo_cache_path(key, file_name, sizeof(file_name));
+    *stale = 0;
+
+    if (logo_index_contains(key))
+    {
+        // file is cached
+        TRACE_BEGIN(start);
+        pixbuf = logo_thumb_load(file_name, &is_thumb);
+        TRACE_END("logo_cache_load", start);
+
+        if (pixbuf == NULL)
+        {
+            fprintf(stderr, "\nFailed to load cached logo '%s'\n", file_name);
+            logo_index_remove(key); // removed or damaged - download again
+        }
+        else
+        {
+            // caches older than the metadata: the age is that of the file
+            struct stat st;
+            if (!logo_meta_load(key, &meta))
+                meta.fetched = (stat(file_name, &st) == 0) ? st.st_mtime : 0;
+
+            *stale = (logo_ttl_hours > 0 && time(NULL) - meta.fetched > (int64_t)logo_ttl_hours * 3600);
+        }
+    }
+
+    int not_modified;
+    if (pixbuf == NULL && (pixbuf = logo_download(curl, url, &meta, &not_modified)) != NULL)
+        printf("\n%s ==> %s", url, file_name);
+
+    if (pixbuf != NULL && !is_thumb)
+        logo_store(key, file_name, pixbuf, &meta);
+
+    g_free(key);
+    return pixbuf;
+}
+
+// asks the server whether a cached logo changed - returns the new one, or NULL if it did not (or it could not be told)
+GdkPixbuf* logo_revalidate(CURL* curl, const char* url)
+{
+    char* key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, url, -1);
+    char file_name[256];
+    logo_meta_t meta = { .magic = LOGO_META_MAGIC };
+    int not_modified;
+
+    logo_cache_path(key, file_name, sizeof(file_name));
+    logo_meta_load(key, &meta); // without validators the whole logo is downloaded again
+
+    GdkPixbuf* pixbuf = logo_download(curl, url, &meta, &not_modified);
+
+    if (pixbuf != NULL)
+        logo_store(key, file_name, pixbuf, &meta);
+    else
+    {
+        // unchanged, or the server failed: the cached logo is good for another TTL
+        meta.fetched = time(NULL);
+        logo_meta_save(key, &meta);
+    }
+
+    g_free(key);
+    return pixbuf;
+}
+
+// =====================================
+// GLOBAL
+// =====================================
+playlist_t playlist;
+int headless = 0; // --headless: no GUI, see CONTROL SOCKET
+
+int selected_group = 0;
+int selected_channel = 0;
+
+GtkBuilder* builder;
+GtkTreeView* chan_tree;
+GtkTreeView* cat_tree;
+GdkRectangle screen_rect;
+
+libvlc_instance_t *vlc_inst;
+libvlc_media_player_t* media_player;
+GtkWidget* channel_player;
+GtkWindow* main_window;
+GtkSearchEntry* search_entry;
+search_index_t search_index; // names of every entry, rebuilt once the playlist is loaded
+
+#define CHAN_TYPE_MODEL (chan_model_get_type())
+G_DECLARE_FINAL_TYPE(ChanModel, chan_model, CHAN, MODEL, GObject)
+
+ChanModel* chan_model; // rows of 'chan_tree' - see CHANNEL LIST MODEL
+
+enum {
+    CHAN_COLUMN_LOGO,
+    CHAN_COLUMN_NAME,
+    CHAN_COLUMN_LOGO_URL,
+    CHAN_COLUMN_STATUS,
+    CHAN_COLUMN_GUIDE,
+    CHAN_NUM_COLUMNS
+};
+void chan_model_logo_changed(ChanModel* model, GtkTreeView* view, const char* logo);
+
+// =====================================
+// LOGO ATLAS
+// =====================================
+
+// decoded logos are copied into cells of a few large surfaces, instead of a pixbuf each,
+// and drawn straight from there by LogoRenderer
+#define LOGO_ATLAS_SIDE     16  // cells in each row and column of a page
+#define LOGO_ATLAS_CELLS    (LOGO_ATLAS_SIDE * LOGO_ATLAS_SIDE)
+#define LOGO_CELL_BYTES     (LOGO_SIZE * LOGO_SIZE * 4)
+#define LOGO_NO_CELL        (-1)
+
+static cairo_surface_t** logo_atlas_pages;
+static uint32_t logo_atlas_num_pages;
+static uint32_t logo_atlas_next;        // cells below this number were handed out at least once
+static uint32_t* logo_atlas_free;       // cells released, reused first
+static uint32_t logo_atlas_num_free;
+static uint32_t logo_atlas_max_free;
+
+// a cell for a new logo - pages are added as needed, their number is kept down by the eviction of the cache
+int logo_atlas_alloc()
+{
+    if (logo_atlas_num_free > 0)
+        return (int)logo_atlas_free[--logo_atlas_num_free];
+
+    if (logo_atlas_next == logo_atlas_num_pages * LOGO_ATLAS_CELLS)
+    {
+        cairo_surface_t* page = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, LOGO_ATLAS_SIDE * LOGO_SIZE, LOGO_ATLAS_SIDE * LOGO_SIZE);
+        if (cairo_surface_status(page) != CAIRO_STATUS_SUCCESS)
+        {
+            cairo_surface_destroy(page);
+            return LOGO_NO_CELL;
+        }
+
+        cairo_surface_t** new_pages = (cairo_surface_t**)realloc(logo_atlas_pages, (logo_atlas_num_pages + 1) * sizeof(cairo_surface_t*));
+        if (new_pages == NULL)
+        {
+            cairo_surface_destroy(page);
+            return LOGO_NO_CELL;
+        }
+
+        logo_atlas_pages = new_pages;
+        logo_atlas_pages[logo_atlas_num_pages++] = page;
+    }
+
+    return (int)logo_atlas_next++;
+}
+
+void logo_atlas_release(int cell)
+{
+    if (cell < 0)
+        return;
+
+    uint32_t* new_free = (uint32_t*)playlist_grow(logo_atlas_free, sizeof(uint32_t), logo_atlas_num_free, &logo_atlas_max_free);
+    if (new_free == NULL)
+        return; // the cell is lost until exit
+
+    logo_atlas_free = new_free;
+    logo_atlas_free[logo_atlas_num_free++] = (uint32_t)cell;
+}
+
+// position of the cell in its page
+static inline cairo_surface_t* logo_atlas_locate(int cell, int* x, int* y)
+{
+    int index = cell % LOGO_ATLAS_CELLS;
+
+    *x = (index % LOGO_ATLAS_SIDE) * LOGO_SIZE;
+    *y = (index / LOGO_ATLAS_SIDE) * LOGO_SIZE;
+
+    return logo_atlas_pages[cell / LOGO_ATLAS_CELLS];
+}
+
+// copies the logo into its cell - the pixbuf may be released afterwards
+void logo_atlas_draw(int cell, GdkPixbuf* pixbuf)
+{
+    int x, y;
+    cairo_t* cr = cairo_create(logo_atlas_locate(cell, &x, &y));
+
+    // replaces the whole cell, so a smaller logo leaves no trace of the previous one
+    cairo_rectangle(cr, x, y, LOGO_SIZE, LOGO_SIZE);
+    cairo_clip(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    gdk_cairo_set_source_pixbuf(cr, pixbuf, x + (LOGO_SIZE - gdk_pixbuf_get_width(pixbuf)) / 2, y + (LOGO_SIZE - gdk_pixbuf_get_height(pixbuf)) / 2);
+    cairo_paint(cr);
+
+    cairo_destroy(cr);
+}
+
+// cell renderer of the logo column: the "cell" property is the atlas cell of the row, LOGO_NO_CELL draws nothing
+#define LOGO_TYPE_RENDERER (logo_renderer_get_type())
+G_DECLARE_FINAL_TYPE(LogoRenderer, logo_renderer, LOGO, RENDERER, GtkCellRenderer)
+
+struct _LogoRenderer {
+    GtkCellRenderer parent;
+    gint cell;
+};
+
+enum { LOGO_RENDERER_PROP_CELL = 1 };
+
+G_DEFINE_TYPE(LogoRenderer, logo_renderer, GTK_TYPE_CELL_RENDERER)
+
+static void logo_renderer_init(LogoRenderer* renderer)
+{
+    renderer->cell = LOGO_NO_CELL;
+}
+
+static void logo_renderer_set_property(GObject* object, guint property_id, const GValue* value, GParamSpec* pspec)
+{
+    if (property_id == LOGO_RENDERER_PROP_CELL)
+        LOGO_RENDERER(object)->cell = g_value_get_int(value);
+    else
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+}
+
+static void logo_renderer_get_property(GObject* object, guint property_id, GValue* value, GParamSpec* pspec)
+{
+    if (property_id == LOGO_RENDERER_PROP_CELL)
+        g_value_set_int(value, LOGO_RENDERER(object)->cell);
+    else
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+}
+
+static void logo_renderer_get_preferred_size(GtkCellRenderer* cell, GtkWidget* widget, gint* minimum, gint* natural)
+{
+    gint xpad, ypad;
+    gtk_cell_renderer_get_padding(cell, &xpad, &ypad);
+
+    // cells are square
+    *minimum = *natural = LOGO_SIZE + 2 * MAX(xpad, ypad);
+}
+
+static void logo_renderer_render(GtkCellRenderer* cell, cairo_t* cr, GtkWidget* widget,
+                                 const GdkRectangle* background_area, const GdkRectangle* cell_area, GtkCellRendererState flags)
+{
+    LogoRenderer* renderer = LOGO_RENDERER(cell);
+
+    if (renderer->cell < 0 || (uint32_t)renderer->cell >= logo_atlas_next)
+        return;
+
+    int cell_x, cell_y;
+    cairo_surface_t* page = logo_atlas_locate(renderer->cell, &cell_x, &cell_y);
+
+    int x = cell_area->x + (cell_area->width - LOGO_SIZE) / 2;
+    int y = cell_area->y + (cell_area->height - LOGO_SIZE) / 2;
+
+    cairo_set_source_surface(cr, page, x - cell_x, y - cell_y);
+    cairo_rectangle(cr, x, y, LOGO_SIZE, LOGO_SIZE);
+    cairo_fill(cr);
+}
+
+static void logo_renderer_class_init(LogoRendererClass* klass)
+{
+    GObjectClass* object_class = G_OBJECT_CLASS(klass);
+    GtkCellRendererClass* cell_class = GTK_CELL_RENDERER_CLASS(klass);
+
+    object_class->set_property = logo_renderer_set_property;
+    object_class->get_property = logo_renderer_get_property;
+    cell_class->get_preferred_width = logo_renderer_get_preferred_size;
+    cell_class->get_preferred_height = logo_renderer_get_preferred_size;
+    cell_class->render = logo_renderer_render;
+
+    g_object_class_install_property(object_class, LOGO_RENDERER_PROP_CELL,
+        g_param_spec_int("cell", "Cell", "Cell of the logo atlas", LOGO_NO_CELL, G_MAXINT, LOGO_NO_CELL, G_PARAM_READWRITE));
+}
+
+// =====================================
+// LOGO CACHE
+// =====================================
+
+// decoded logos shared by all entries with the same url, evicted least recently used first
+typedef struct logo_cache_node {
+    char* url;
+    int cell;           // in the atlas - LOGO_NO_CELL while downloading or if the download failed
+    uint8_t pending;    // a job is downloading it
+    size_t bytes;       // memory accounted to this logo
+    GList link;         // position in 'logo_lru'
+} logo_cache_node_t;
+
+int logo_cache_mb = 32; // memory budget for decoded logos (--logo-cache-mb)
+
+static GHashTable* logo_cache;              // url => logo_cache_node_t
+static GQueue logo_lru = G_QUEUE_INIT;      // head is the most recently used
+static size_t logo_cache_bytes;
+static struct {
+    unsigned hits;
+    unsigned misses;
+    unsigned evictions;
+} logo_cache_stats;
+
+void logo_cache_node_free(gpointer data)
+{
+    logo_cache_node_t* node = (logo_cache_node_t*)data;
+
+    logo_atlas_release(node->cell);
+
+    free(node->url);
+    free(node);
+}
+
+void logo_cache_init()
+{
+    logo_cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, logo_cache_node_free);
+}
+
+// copies the logo into the atlas - the pixbuf is not kept
+void logo_cache_set(logo_cache_node_t* node, GdkPixbuf* pixbuf)
+{
+    if (node->cell < 0 && (node->cell = logo_atlas_alloc()) < 0)
+        return;
+
+    logo_atlas_draw(node->cell, pixbuf);
+
+    logo_cache_bytes += LOGO_CELL_BYTES - node->bytes;
+    node->bytes = LOGO_CELL_BYTES;
+}
+
+void logo_cache_touch(logo_cache_node_t* node)
+{
+    g_queue_unlink(&logo_lru, &node->link);
+    g_queue_push_head_link(&logo_lru, &node->link);
+}
+
+void logo_cache_remove(logo_cache_node_t* node)
+{
+    logo_cache_bytes -= node->bytes;
+    g_queue_unlink(&logo_lru, &node->link);
+    g_hash_table_remove(logo_cache, node->url); // frees the node
+}
+
+// checks whether a row currently drawn in 'chan_tree' shows this logo
+int logo_cache_visible(const char* url)
+{
+    GtkTreePath *start, *end;
+
+    if (chan_model == NULL || !gtk_tree_view_get_visible_range(chan_tree, &start, &end))
+        return 0;
+
+    int visible = 0;
+    GtkTreeIter iter;
+    gint first = gtk_tree_path_get_indices(start)[0];
+    gint last = gtk_tree_path_get_indices(end)[0];
+
+    for (gint row = first; row <= last && !visible; row++)
+        if (gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(chan_model), &iter, NULL, row))
+        {
+            GValue value = G_VALUE_INIT;
+            gtk_tree_model_get_value(GTK_TREE_MODEL(chan_model), &iter, CHAN_COLUMN_LOGO_URL, &value);
+            visible = (strcmp(g_value_get_string(&value), url) == 0);
+            g_value_unset(&value);
+        }
+
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+
+    return visible;
+}
+
+// drops decoded logos from the tail of the list until the budget is met
+void logo_cache_evict()
+{
+    size_t budget = (size_t)logo_cache_mb * 1024 * 1024;
+    guint skipped = 0;
+
+    while (logo_cache_bytes > budget && skipped < logo_lru.length)
+    {
+        logo_cache_node_t* node = (logo_cache_node_t*)g_queue_peek_tail(&logo_lru);
+
+        if (node->pending || logo_cache_visible(node->url))
+        {
+            // still needed - keep it as if recently used
+            logo_cache_touch(node);
+            skipped++;
+            continue;
+        }
+
+        logo_cache_remove(node);
+        logo_cache_stats.evictions++;
+    }
+}
+
+void logo_cache_report()
+{
+    printf("\nLogo cache: %u hits, %u misses, %u evictions, %u logos using %zu KiB\n",
+           logo_cache_stats.hits, logo_cache_stats.misses, logo_cache_stats.evictions,
+           g_hash_table_size(logo_cache), logo_cache_bytes / 1024);
+}
+
+// =====================================
+// LOGO PIPELINE
+// =====================================
+#define LOGO_WORKERS        6   // max simultaneous logo downloads
+#define LOGO_MAX_PER_HOST   2   // max simultaneous logo downloads from the same server
+#define LOGO_PREFETCH_WORKERS 2 // workers which may run prefetch jobs - the others are kept for the logos being shown
+
+typedef struct logo_job {
+    char* url;
+    char* host;
+    GdkPixbuf* pixbuf;  // result of the download - NULL if it failed
+    uint8_t refresh;    // newer version of a logo already shown
+    uint8_t prefetch;   // logo of a group not shown yet - see LOGO PREFETCH
+} logo_job_t;
+
+static GMutex logo_lock;
+static GCond logo_cond;
+static GQueue logo_pending = G_QUEUE_INIT;  // jobs waiting for a worker
+static GQueue logo_prefetch = G_QUEUE_INIT; // low priority jobs, only taken when 'logo_pending' has none ready
+static guint logo_prefetch_active;          // prefetch jobs being run
+static GHashTable* logo_host_active;        // host name => number of jobs being downloaded from it
+
+char* logo_url_host(const char* url)
+{
+    const char* begin = strstr(url, "://");
+    begin = (begin == NULL) ? url : begin + 3;
+
+    size_t len = strcspn(begin, "/?#");
+    return g_strndup(begin, len);
+}
+
+void logo_job_free(logo_job_t* job)
+{
+    free(job->url);
+    g_free(job->host);
+    free(job);
+}
+
+// pops the first job of the queue whose host did not exceed the limit of connections (must hold 'logo_lock')
+logo_job_t* logo_take_from(GQueue* queue)
+{
+    for (GList* node = queue->head; node != NULL; node = node->next)
+    {
+        logo_job_t* job = (logo_job_t*)node->data;
+        guint active = GPOINTER_TO_UINT(g_hash_table_lookup(logo_host_active, job->host));
+
+        if (active >= LOGO_MAX_PER_HOST)
+            continue; // busy - try the next one
+
+        g_queue_delete_link(queue, node);
+        g_hash_table_replace(logo_host_active, g_strdup(job->host), GUINT_TO_POINTER(active + 1));
+
+        return job;
+    }
+
+    return NULL;
+}
+
+// logos being shown come first, prefetches only use a few of the workers (must hold 'logo_lock')
+logo_job_t* logo_take_job()
+{
+    logo_job_t* job = logo_take_from(&logo_pending);
+
+    if (job == NULL && logo_prefetch_active < LOGO_PREFETCH_WORKERS && (job = logo_take_from(&logo_prefetch)) != NULL)
+        logo_prefetch_active++;
+
+    return job;
+}
+
+gboolean logo_job_done(gpointer data)
+{
+    logo_job_t* job = (logo_job_t*)data;
+
+    // the cache is owned by the GTK thread, so here it is safe to touch it
+    logo_cache_node_t* node = (logo_cache_node_t*)g_hash_table_lookup(logo_cache, job->url);
+
+    if (job->refresh)
+    {
+        // unless it was evicted or is being loaded again meanwhile
+        if (node != NULL && !node->pending && job->pixbuf != NULL)
+        {
+            logo_cache_set(node, job->pixbuf);
+
+            chan_model_logo_changed(chan_model, chan_tree, node->url);
+            logo_cache_evict();
+        }
+    }
+    else if (job->prefetch)
+    {
+        // nobody asked for it yet: kept as the least recently used logo, so it never evicts one in use
+        if (node == NULL && job->pixbuf != NULL && (node = (logo_cache_node_t*)malloc(sizeof(logo_cache_node_t))) != NULL)
+        {
+            *node = (logo_cache_node_t) {
+                .url = strdup(job->url),
+                .cell = LOGO_NO_CELL,
+                .pending = 0,
+                .bytes = 0,
+                .link = { .data = node },
+            };
+
+            g_hash_table_insert(logo_cache, node->url, node);
+            g_queue_push_tail_link(&logo_lru, &node->link);
+
+            logo_cache_set(node, job->pixbuf);
+            logo_cache_evict();
+        }
+    }
+    else if (node != NULL)
+    {
+        node->pending = 0;
+
+        if (job->pixbuf != NULL)
+        {
+            logo_cache_set(node, job->pixbuf);
+
+            // swap the placeholder by the logo in the rows being shown
+            chan_model_logo_changed(chan_model, chan_tree, node->url);
+            logo_cache_evict();
+        }
+    }
+
+    if (job->pixbuf != NULL)
+        g_object_unref(job->pixbuf);
+
+    logo_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+gpointer logo_worker(gpointer data)
+{
+    CURL* curl = logo_curl_new();
+
+    for (;;)
+    {
+        logo_job_t* job;
+
+        g_mutex_lock(&logo_lock);
+        while ((job = logo_take_job()) == NULL)
+            g_cond_wait(&logo_cond, &logo_lock);
+        g_mutex_unlock(&logo_lock);
+
+        int stale;
+        job->pixbuf = cache_or_download_logo(curl, job->url, &stale);
+
+        // the cached logo is shown at once, and replaced if the server has a newer one
+        logo_job_t* refresh = stale ? (logo_job_t*)calloc(1, sizeof(logo_job_t)) : NULL;
+
+        if (refresh != NULL && (refresh->url = strdup(job->url)) == NULL)
+        {
+            free(refresh);
+            refresh = NULL; // out of memory: checked again next time it is shown
+        }
+
+        if (refresh != NULL)
+        {
+            refresh->host = g_strdup(job->host);
+            refresh->refresh = 1;
+            refresh->prefetch = job->prefetch;
+
+            g_idle_add(logo_job_done, job);
+
+            job = refresh;
+            job->pixbuf = logo_revalidate(curl, job->url);
+        }
+
+        // release the host slot so other jobs from the same server may run
+        g_mutex_lock(&logo_lock);
+        guint active = GPOINTER_TO_UINT(g_hash_table_lookup(logo_host_active, job->host));
+        if (active <= 1)
+            g_hash_table_remove(logo_host_active, job->host);
+        else
+            g_hash_table_replace(logo_host_active, g_strdup(job->host), GUINT_TO_POINTER(active - 1));
+        if (job->prefetch)
+            logo_prefetch_active--;
+        g_cond_broadcast(&logo_cond);
+        g_mutex_unlock(&logo_lock);
+
+        g_idle_add(logo_job_done, job);
+    }
+
+    return NULL;
+}
+
+void logo_pipeline_init()
+{
+    logo_host_active = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    logo_cache_init();
+    logo_share_init();
+
+    for (int w = 0; w < LOGO_WORKERS; w++)
+        g_thread_unref(g_thread_new("logo", logo_worker, NULL));
+}
+
+// drops the jobs which did not start yet (e.g. the user left the category)
+void logo_pipeline_cancel()
+{
+    g_mutex_lock(&logo_lock);
+
+    logo_job_t* job;
+    while ((job = (logo_job_t*)g_queue_pop_head(&logo_pending)) != NULL)
+    {
+        // forget it, so it is requested again if shown later
+        logo_cache_node_t* node = (logo_cache_node_t*)g_hash_table_lookup(logo_cache, job->url);
+        if (node != NULL)
+            logo_cache_remove(node);
+
+        logo_job_free(job);
+    }
+
+    g_mutex_unlock(&logo_lock);
+}
+
+// atlas cell of the logo - LOGO_NO_CELL (blank) while it is not available
+int get_channel_logo(int group_index, int entry_index)
+{
+    const char* url = playlist.groups[group_index].entries[entry_index].logo;
+
+    if (url[0] == '\0')
+        return LOGO_NO_CELL; // no logo at all
+
+    logo_cache_node_t* node = (logo_cache_node_t*)g_hash_table_lookup(logo_cache, url);
+
+    if (node != NULL)
+    {
+        logo_cache_touch(node);
+
+        if (node->pending)
+            return LOGO_NO_CELL; // already requested
+
+        logo_cache_stats.hits++;
+        return node->cell;
+    }
+
+    logo_cache_stats.misses++;
+
+    // request the logo in background
+    logo_job_t* job = (logo_job_t*)malloc(sizeof(logo_job_t));
+    node = (logo_cache_node_t*)malloc(sizeof(logo_cache_node_t));
+
+    if (job == NULL || node == NULL)
+    {
+        free(job);
+        free(node);
+        return LOGO_NO_CELL;
+    }
+
+    *node = (logo_cache_node_t) {
+        .url = strdup(url),
+        .cell = LOGO_NO_CELL,
+        .pending = 1,
+        .bytes = 0,
+        .link = { .data = node },
+    };
+
+    *job = (logo_job_t) {
+        .url = strdup(url),
+        .host = logo_url_host(url),
+        .pixbuf = NULL,
+    };
+
+    g_hash_table_insert(logo_cache, node->url, node);
+    g_queue_push_head_link(&logo_lru, &node->link);
+
+    g_mutex_lock(&logo_lock);
+    g_queue_push_tail(&logo_pending, job);
+    g_cond_signal(&logo_cond);
+    g_mutex_unlock(&logo_lock);
+
+    return LOGO_NO_CELL;
+}
+
+// =====================================
+// LOGO PREFETCH
+// =====================================
+
+// while the user is idle in the menus, the logos of the groups next to the selected one and of the
+// groups visited recently are loaded into the caches, so their first visit shows them at once
+#define LOGO_PREFETCH_DELAY     3   // seconds without navigating before prefetching starts
+#define LOGO_PREFETCH_MAX       400 // logos queued at a time
+#define LOGO_PREFETCH_RECENT    4   // recently visited groups kept
+
+static int logo_recent_groups[LOGO_PREFETCH_RECENT] = { -1, -1, -1, -1 }; // most recent first
+static guint logo_prefetch_timer;
+static int logo_prefetch_paused;    // a stream is playing - it keeps the bandwidth
+
+// drops the prefetches which did not start yet
+void logo_prefetch_cancel()
+{
+    if (logo_prefetch_timer != 0)
+    {
+        g_source_remove(logo_prefetch_timer);
+        logo_prefetch_timer = 0;
+    }
+
+    g_mutex_lock(&logo_lock);
+
+    logo_job_t* job;
+    while ((job = (logo_job_t*)g_queue_pop_head(&logo_prefetch)) != NULL)
+        logo_job_free(job);
+
+    g_mutex_unlock(&logo_lock);
+}
+
+// queues the logos of a group which are not in memory yet - returns how many more may be queued
+int logo_prefetch_group(int group, GHashTable* queued, int budget)
+{
+    if (group < 0 || group >= (int)playlist.num_groups)
+        return budget;
+
+    playlist_group_t* gro = &playlist.groups[group];
+
+    for (uint32_t e = 0; e < gro->num_entries && budget > 0; e++)
+    {
+        const char* url = gro->entries[e].logo;
+
+        if (url[0] == '\0' || g_hash_table_contains(queued, url) || g_hash_table_contains(logo_cache, url))
+            continue;
+
+        logo_job_t* job = (logo_job_t*)malloc(sizeof(logo_job_t));
+        if (job == NULL)
+            break;
+
+        *job = (logo_job_t) {
+            .url = strdup(url),
+            .host = logo_url_host(url),
+            .pixbuf = NULL,
+            .prefetch = 1,
+        };
+
+        g_hash_table_add(queued, (gpointer)url);
+        g_queue_push_tail(&logo_prefetch, job);
+        budget--;
+    }
+
+    return budget;
+}
+
+gboolean logo_prefetch_run(gpointer data)
+{
+    logo_prefetch_timer = 0;
+
+    // the neighbours first, as the user is most likely to step into them
+    int groups[2 + LOGO_PREFETCH_RECENT] = { selected_group + 1, selected_group - 1 };
+    for (int r = 0; r < LOGO_PREFETCH_RECENT; r++)
+        groups[2 + r] = logo_recent_groups[r];
+
+    GHashTable* queued = g_hash_table_new(g_str_hash, g_str_equal);
+    int budget = LOGO_PREFETCH_MAX;
+
+    g_mutex_lock(&logo_lock);
+
+    for (int g = 0; g < 2 + LOGO_PREFETCH_RECENT && budget > 0; g++)
+        if (groups[g] != selected_group) // the selected group is requested as it is shown
+            budget = logo_prefetch_group(groups[g], queued, budget);
+
+    g_cond_broadcast(&logo_cond);
+    g_mutex_unlock(&logo_lock);
+
+    g_hash_table_destroy(queued);
+    return G_SOURCE_REMOVE;
+}
+
+// starts over once the user stops navigating for a while
+void logo_prefetch_schedule()
+{
+    logo_prefetch_cancel();
+
+    if (!logo_prefetch_paused)
+        logo_prefetch_timer = g_timeout_add_seconds(LOGO_PREFETCH_DELAY, logo_prefetch_run, NULL);
+}
+
+void logo_prefetch_visited(int group)
+{
+    int r;
+    for (r = 0; r < LOGO_PREFETCH_RECENT - 1 && logo_recent_groups[r] != group; r++)
+        ;
+
+    memmove(&logo_recent_groups[1], &logo_recent_groups[0], r * sizeof(int));
+    logo_recent_groups[0] = group;
+}
+
+// nothing is prefetched while a stream plays
+void logo_prefetch_pause(int paused)
+{
+    logo_prefetch_paused = paused;
+
+    if (paused)
+        logo_prefetch_cancel();
+    else
+        logo_prefetch_schedule();
+}
+
+// =====================================
+// PROGRAM GUIDE
+// =====================================
+
+// XMLTV guides are often hundreds of MB: they are parsed as they are read, in a thread of their own,
+// keeping only the programmes of the playlist's channels which end within the next 'epg_hours'
+char* epg_source;   // --epg, file or url of the XMLTV guide (may be gzipped)
+int epg_hours = 24; // --epg-hours
+
+typedef struct epg_programme {
+    gint64 start;       // unix time
+    gint64 stop;
+    const char* title;  // in the guide's string chunk - repeated titles are stored once
+} epg_programme_t;
+
+typedef struct epg_channel {
+    uint32_t num_programmes;
+    uint32_t max_programmes;
+    epg_programme_t* programmes; // sorted by start once loaded
+} epg_channel_t;
+
+typedef struct epg {
+    GHashTable* channels;   // tvg-id -> epg_channel_t
+    GStringChunk* strings;
+    uint32_t num_programmes;
+} epg_t;
+
+epg_t* epg; // guide in use - read and replaced by the GTK thread only
+
+void epg_channel_free(gpointer data)
+{
+    epg_channel_t* channel = (epg_channel_t*)data;
+    free(channel->programmes);
+    free(channel);
+}
+
+epg_t* epg_new()
+{
+    epg_t* guide = (epg_t*)malloc(sizeof(epg_t));
+    if (guide == NULL)
+        return NULL;
+
+    guide->channels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, epg_channel_free);
+    guide->strings = g_string_chunk_new(64 * 1024);
+    guide->num_programmes = 0;
+
+    return guide;
+}
+
+void epg_free(epg_t* guide)
+{
+    if (guide == NULL)
+        return;
+
+    g_hash_table_destroy(guide->channels);
+    g_string_chunk_free(guide->strings);
+    free(guide);
+}
+
+// days since 1970-01-01 of a date of the proleptic Gregorian calendar
+static gint64 epg_days_from_civil(int y, int m, int d)
+{
+    y -= (m <= 2);
+    gint64 era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (gint64)doe - 719468;
+}
+
+// "20201014183000 -0300" - returns -1 if malformed
+gint64 epg_parse_time(const char* str)
+{
+    int y, mo, d, h, mi, s = 0, n = 0;
+    char sign = '+';
+    int zone = 0;
+
+    if (str == NULL || sscanf(str, "%4d%2d%2d%2d%2d%n", &y, &mo, &d, &h, &mi, &n) != 5)
+        return -1;
+
+    str += n;
+    if (isdigit((unsigned char)str[0]) && isdigit((unsigned char)str[1]))
+    {
+        s = (str[0] - '0') * 10 + (str[1] - '0');
+        str += 2;
+    }
+
+    while (*str == ' ')
+        str++;
+
+    if ((*str == '+' || *str == '-') && sscanf(str + 1, "%4d", &zone) == 1)
+        sign = *str;
+
+    gint64 offset = (zone / 100) * 3600 + (zone % 100) * 60;
+    gint64 time = epg_days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s;
+
+    return (sign == '+') ? time - offset : time + offset;
+}
+
+typedef struct epg_parser {
+    epg_t* guide;
+    GHashTable* wanted;         // tvg-ids of the playlist
+    gint64 from, to;            // window of time kept
+    epg_channel_t* channel;     // of the programme being parsed - NULL if it is skipped
+    gint64 start, stop;
+    GString* title;
+    uint8_t in_title;
+    uint8_t has_title;
+    GMarkupParseContext* markup;
+    GConverter* gunzip;         // NULL until the data is known to be gzipped
+    uint8_t sniffed;
+    uint8_t failed;
+} epg_parser_t;
+
+static void epg_start_element(GMarkupParseContext* context, const gchar* element, const gchar** names, const gchar** values, gpointer user, GError** error)
+{
+    epg_parser_t* parser = (epg_parser_t*)user;
+
+    if (strcmp(element, "programme") == 0)
+    {
+        const char *channel = NULL, *start = NULL, *stop = NULL;
+
+        for (int a = 0; names[a] != NULL; a++)
+        {
+            if (strcmp(names[a], "channel") == 0)
+                channel = values[a];
+            else if (strcmp(names[a], "start") == 0)
+                start = values[a];
+            else if (strcmp(names[a], "stop") == 0)
+                stop = values[a];
+        }
+
+        parser->channel = NULL;
+        parser->has_title = 0;
+        g_string_truncate(parser->title, 0);
+
+        if (channel == NULL || !g_hash_table_contains(parser->wanted, channel))
+            return;
+
+        parser->start = epg_parse_time(start);
+        parser->stop = epg_parse_time(stop);
+
+        if (parser->start < 0 || parser->stop <= parser->from || parser->start >= parser->to)
+            return;
+
+        parser->channel = (epg_channel_t*)g_hash_table_lookup(parser->guide->channels, channel);
+
+        if (parser->channel == NULL && (parser->channel = (epg_channel_t*)calloc(1, sizeof(epg_channel_t))) != NULL)
+            g_hash_table_insert(parser->guide->channels, g_strdup(channel), parser->channel);
+    }
+    else if (strcmp(element, "title") == 0 && parser->channel != NULL && !parser->has_title)
+        parser->in_title = 1;
+}
+
+static void epg_end_element(GMarkupParseContext* context, const gchar* element, gpointer user, GError** error)
+{
+    epg_parser_t* parser = (epg_parser_t*)user;
+
+    if (strcmp(element, "title") == 0 && parser->in_title)
+    {
+        parser->in_title = 0;
+        parser->has_title = 1;
+    }
+    else if (strcmp(element, "programme") == 0 && parser->channel != NULL)
+    {
+        epg_channel_t* channel = parser->channel;
+        parser->channel = NULL;
+
+        epg_programme_t* programmes = (epg_programme_t*)playlist_grow(channel->programmes, sizeof(epg_programme_t), channel->num_programmes, &channel->max_programmes);
+        if (programmes == NULL)
+            return;
+
+        channel->programmes = programmes;
+
+        channel->programmes[channel->num_programmes++] = (epg_programme_t) {
+            .start = parser->start,
+            .stop = (parser->stop > parser->start) ? parser->stop : parser->start,
+            .title = g_string_chunk_insert_const(parser->guide->strings, parser->title->str),
+        };
+
+        parser->guide->num_programmes++;
+    }
+}
+
+static void epg_text(GMarkupParseContext* context, const gchar* text, gsize len, gpointer user, GError** error)
+{
+    epg_parser_t* parser = (epg_parser_t*)user;
+
+    if (parser->in_title)
+        g_string_append_len(parser->title, text, len);
+}
+
+static const GMarkupParser epg_markup_parser = {
+    .start_element = epg_start_element,
+    .end_element = epg_end_element,
+    .text = epg_text,
+};
+
+void epg_parse_xml(epg_parser_t* parser, const char* data, size_t len)
+{
+    GError* error = NULL;
+
+    if (parser->failed || g_markup_parse_context_parse(parser->markup, data, len, &error))
+        return;
+
+    // what was parsed until the error is kept
+    fprintf(stderr, "\nProgram guide: %s\n", error->message);
+    g_error_free(error);
+    parser->failed = 1;
+}
+
+// accepts the guide in chunks of any size, gzipped or not
+void epg_parser_feed(epg_parser_t* parser, const char* data, size_t len)
+{
+    if (!parser->sniffed && len > 0)
+    {
+        parser->sniffed = 1;
+
+        if (len >= 2 && (uint8_t)data[0] == 0x1f && (uint8_t)data[1] == 0x8b)
+            parser->gunzip = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+    }
+
+    if (parser->gunzip == NULL)
+    {
+        epg_parse_xml(parser, data, len);
+        return;
+    }
+
+    char out[64 * 1024];
+
+    while (len > 0 && !parser->failed)
+    {
+        gsize read = 0, written = 0;
+        GError* error = NULL;
+
+        GConverterResult result = g_converter_convert(parser->gunzip, data, len, out, sizeof(out), G_CONVERTER_NO_FLAGS, &read, &written, &error);
+
+        if (result == G_CONVERTER_ERROR)
+        {
+            fprintf(stderr, "\nProgram guide: %s\n", error->message);
+            g_error_free(error);
+            parser->failed = 1;
+            return;
+        }
+
+        epg_parse_xml(parser, out, written);
+        data += read;
+        len -= read;
+
+        if (result == G_CONVERTER_FINISHED)
+            break;
+    }
+}
+
+size_t epg_curl_write(char* data, size_t size, size_t nmemb, void* user)
+{
+    epg_parser_feed((epg_parser_t*)user, data, size * nmemb);
+    return size * nmemb;
+}
+
+// reads the whole source through the parser - returns 0 if it could not be read
+int epg_read(epg_parser_t* parser, const char* source)
+{
+    if (playlist_is_url(source))
+    {
+        CURL* curl = curl_easy_init();
+        if (curl == NULL)
+            return 0;
+
+        curl_easy_setopt(curl, CURLOPT_URL, source);
+        curl_easy_setopt(curl, CURLOPT_USERAGENT, http_user_agent);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, epg_curl_write);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, parser);
+
+        CURLcode result = curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+
+        if (result != CURLE_OK)
+        {
+            fprintf(stderr, "\nCannot download program guide %s: %s\n", source, curl_easy_strerror(result));
+            return 0;
+        }
+
+        return 1;
+    }
+
+    int fd = open(source, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "\nCannot open program guide %s\n", source);
+        return 0;
+    }
+
+    char chunk[64 * 1024];
+    ssize_t len;
+
+    while ((len = read(fd, chunk, sizeof(chunk))) > 0)
+        epg_parser_feed(parser, chunk, len);
+
+    close(fd);
+    return 1;
+}
+
+static gint epg_compare_start(gconstpointer a, gconstpointer b)
+{
+    gint64 sa = ((const epg_programme_t*)a)->start;
+    gint64 sb = ((const epg_programme_t*)b)->start;
+
+    return (sa > sb) - (sa < sb);
+}
+
+gboolean epg_loaded(gpointer data)
+{
+    epg_t* guide = (epg_t*)data;
+
+    printf("\nProgram guide loaded: %u programmes of %u channels\n", guide->num_programmes, g_hash_table_size(guide->channels));
+
+    epg_free(epg);
+    epg = guide;
+
+    gtk_widget_queue_draw(GTK_WIDGET(chan_tree));
+    return G_SOURCE_REMOVE;
+}
+
+gpointer epg_worker(gpointer data)
+{
+    GHashTable* wanted = (GHashTable*)data;
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+    epg_parser_t parser = {
+        .guide = epg_new(),
+        .wanted = wanted,
+        .from = now,
+        .to = now + (gint64)epg_hours * 3600,
+        .title = g_string_new(NULL),
+    };
+
+    if (parser.guide != NULL)
+    {
+        parser.markup = g_markup_parse_context_new(&epg_markup_parser, 0, &parser, NULL);
+
+        TRACE_BEGIN(start);
+
+        if (epg_read(&parser, epg_source) && !parser.failed)
+            g_markup_parse_context_end_parse(parser.markup, NULL);
+
+        g_markup_parse_context_free(parser.markup);
+
+        if (parser.gunzip != NULL)
+            g_object_unref(parser.gunzip);
+
+        // guides are usually sorted already, but not always
+        GHashTableIter iter;
+        gpointer channel;
+
+        g_hash_table_iter_init(&iter, parser.guide->channels);
+        while (g_hash_table_iter_next(&iter, NULL, &channel))
+        {
+            epg_channel_t* c = (epg_channel_t*)channel;
+            qsort(c->programmes, c->num_programmes, sizeof(epg_programme_t), epg_compare_start);
+        }
+
+        TRACE_END("epg_load", start);
+
+        g_idle_add(epg_loaded, parser.guide);
+    }
+
+    g_string_free(parser.title, TRUE);
+    g_hash_table_destroy(wanted);
+    return NULL;
+}
+
+// loads the guide of the channels in the playlist, in background
+void epg_start()
+{
+    if (epg_source == NULL)
+        return;
+
+    GHashTable* wanted = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (uint32_t g = 0; g < playlist.num_groups; g++)
+        for (uint32_t e = 0; e < playlist.groups[g].num_entries; e++)
+            if (playlist.groups[g].entries[e].id[0] != '\0')
+                g_hash_table_add(wanted, g_strdup(playlist.groups[g].entries[e].id));
+
+    g_thread_unref(g_thread_new("epg", epg_worker, wanted));
+}
+
+// programmes on air and following for the channel - O(log n)
+void epg_now_next(const char* id, gint64 now, const epg_programme_t** current, const epg_programme_t** next)
+{
+    *current = *next = NULL;
+
+    epg_channel_t* channel = (epg == NULL || id[0] == '\0') ? NULL : (epg_channel_t*)g_hash_table_lookup(epg->channels, id);
+    if (channel == NULL)
+        return;
+
+    // first programme starting after now
+    uint32_t low = 0, high = channel->num_programmes;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (channel->programmes[mid].start <= now)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low > 0 && channel->programmes[low - 1].stop > now)
+        *current = &channel->programmes[low - 1];
+
+    if (low < channel->num_programmes)
+        *next = &channel->programmes[low];
+}
+
+// text of the guide column
+char* epg_describe(const char* id)
+{
+    const epg_programme_t *current, *next;
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+    epg_now_next(id, now, &current, &next);
+
+    if (next == NULL)
+        return g_strdup((current == NULL) ? "" : current->title);
+
+    GDateTime* time = g_date_time_new_from_unix_local(next->start);
+    char* hour = g_date_time_format(time, "%H:%M");
+    char* text = g_strdup_printf("%s\n%s %s", (current == NULL) ? "" : current->title, hour, next->title);
+
+    g_free(hour);
+    g_date_time_unref(time);
+    return text;
+}
+
+// what is on air changes as time goes by
+gboolean epg_tick(gpointer data)
+{
+    if (epg != NULL)
+        gtk_widget_queue_draw(GTK_WIDGET(chan_tree));
+
+    return G_SOURCE_CONTINUE;
+}
+
+// =====================================
+// CHANNEL LIST MODEL
+// =====================================
+
+// exposes the entries of a group to 'chan_tree' without copying them into a store:
+// the view only reads the rows it renders, so only those logos are requested
+struct _ChanModel {
+    GObject parent;
+    gint stamp;         // changes whenever the rows are replaced, invalidating old iterators
+    int group;          // group being shown - -1 for none, CHAN_GROUP_RESULTS when showing 'rows' only
+    uint32_t num_rows;  // rows the view was told about (the group may still be loading)
+    uint32_t num_seen;  // entries of the group already placed in rows (or hidden)
+    playlist_ref_t* rows; // entry shown in each row - NULL in playlist order
+    uint32_t max_rows;
+};
+
+#define CHAN_GROUP_RESULTS (-2)
+
+// how the channels are listed, switched with F2
+enum { CHAN_ORDER_PLAYLIST, CHAN_ORDER_HEALTH, CHAN_ORDER_ALIVE, CHAN_NUM_ORDERS };
+int chan_order = CHAN_ORDER_PLAYLIST;
+
+
+static void chan_model_tree_model_init(GtkTreeModelIface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(ChanModel, chan_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, chan_model_tree_model_init))
+
+static void chan_model_class_init(ChanModelClass* klass)
+{
+}
+
+static void chan_model_init(ChanModel* model)
+{
+    model->stamp = g_random_int();
+    model->group = -1;
+    model->num_rows = 0;
+    model->num_seen = 0;
+    model->rows = NULL;
+    model->max_rows = 0;
+}
+
+static GtkTreeModelFlags chan_model_get_flags(GtkTreeModel* tree_model)
+{
+    return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint chan_model_get_n_columns(GtkTreeModel* tree_model)
+{
+    return CHAN_NUM_COLUMNS;
+}
+
+static GType chan_model_get_column_type(GtkTreeModel* tree_model, gint column)
+{
+    return (column == CHAN_COLUMN_LOGO) ? G_TYPE_INT : G_TYPE_STRING;
+}
+
+// entry shown in the row - out of the playlist bounds if there is no such row
+playlist_ref_t chan_model_ref(ChanModel* model, uint32_t row)
+{
+    if (model->rows == NULL || row >= model->num_rows)
+        return (playlist_ref_t) { .group = (uint32_t)model->group, .entry = row };
+
+    return model->rows[row];
+}
+
+// row showing the entry - -1 if hidden or not in the view
+int chan_model_row_of(ChanModel* model, int group, int entry)
+{
+    if (model->rows == NULL)
+        return (group == model->group && entry >= 0 && (uint32_t)entry < model->num_rows) ? entry : -1;
+
+    for (uint32_t row = 0; row < model->num_rows; row++)
+        if (model->rows[row].group == (uint32_t)group && model->rows[row].entry == (uint32_t)entry)
+            return row;
+
+    return -1;
+}
+
+int entry_is_dead(const playlist_entry_t* entry)
+{
+    return entry->status < 0 || entry->status >= 400;
+}
+
+static gboolean chan_model_make_iter(ChanModel* model, GtkTreeIter* iter, guint row)
+{
+    if (row >= model->num_rows)
+        return FALSE;
+
+    iter->stamp = model->stamp;
+    iter->user_data = GUINT_TO_POINTER(row);
+    return TRUE;
+}
+
+static gboolean chan_model_get_iter(GtkTreeModel* tree_model, GtkTreeIter* iter, GtkTreePath* path)
+{
+    if (gtk_tree_path_get_depth(path) != 1)
+        return FALSE;
+
+    return chan_model_make_iter(CHAN_MODEL(tree_model), iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath* chan_model_get_path(GtkTreeModel* tree_model, GtkTreeIter* iter)
+{
+    return gtk_tree_path_new_from_indices(GPOINTER_TO_UINT(iter->user_data), -1);
+}
+
+static void chan_model_get_value(GtkTreeModel* tree_model, GtkTreeIter* iter, gint column, GValue* value)
+{
+    ChanModel* model = CHAN_MODEL(tree_model);
+    guint row = GPOINTER_TO_UINT(iter->user_data);
+
+    g_value_init(value, chan_model_get_column_type(tree_model, column));
+
+    if (row >= model->num_rows || (model->group < 0 && model->rows == NULL))
+        return;
+
+    playlist_ref_t ref = chan_model_ref(model, row);
+    playlist_entry_t* entry = &playlist.groups[ref.group].entries[ref.entry];
+
+    if (column == CHAN_COLUMN_LOGO)
+        g_value_set_int(value, get_channel_logo(ref.group, ref.entry));
+    else if (column == CHAN_COLUMN_NAME) // strings live as long as the playlist
+        g_value_set_static_string(value, entry->name);
+    else if (column == CHAN_COLUMN_LOGO_URL)
+        g_value_set_static_string(value, entry->logo);
+    else if (column == CHAN_COLUMN_GUIDE)
+        g_value_take_string(value, epg_describe(entry->id));
+    else if (entry->status == 0)
+        g_value_set_static_string(value, "");
+    else if (entry_is_dead(entry))
+        g_value_set_static_string(value, "offline");
+    else
+        g_value_take_string(value, g_strdup_printf("%u ms", entry->latency_ms));
+}
+
+static gboolean chan_model_iter_next(GtkTreeModel* tree_model, GtkTreeIter* iter)
+{
+    return chan_model_make_iter(CHAN_MODEL(tree_model), iter, GPOINTER_TO_UINT(iter->user_data) + 1);
+}
+
+static gboolean chan_model_iter_children(GtkTreeModel* tree_model, GtkTreeIter* iter, GtkTreeIter* parent)
+{
+    return (parent == NULL) && chan_model_make_iter(CHAN_MODEL(tree_model), iter, 0);
+}
+
+static gboolean chan_model_iter_has_child(GtkTreeModel* tree_model, GtkTreeIter* iter)
+{
+    return FALSE;
+}
+
+static gint chan_model_iter_n_children(GtkTreeModel* tree_model, GtkTreeIter* iter)
+{
+    return (iter == NULL) ? (gint)CHAN_MODEL(tree_model)->num_rows : 0;
+}
+
+static gboolean chan_model_iter_nth_child(GtkTreeModel* tree_model, GtkTreeIter* iter, GtkTreeIter* parent, gint n)
+{
+    return (parent == NULL) && n >= 0 && chan_model_make_iter(CHAN_MODEL(tree_model), iter, n);
+}
+
+static gboolean chan_model_iter_parent(GtkTreeModel* tree_model, GtkTreeIter* iter, GtkTreeIter* child)
+{
+    return FALSE;
+}
+
+static void chan_model_tree_model_init(GtkTreeModelIface* iface)
+{
+    iface->get_flags = chan_model_get_flags;
+    iface->get_n_columns = chan_model_get_n_columns;
+    iface->get_column_type = chan_model_get_column_type;
+    iface->get_iter = chan_model_get_iter;
+    iface->get_path = chan_model_get_path;
+    iface->get_value = chan_model_get_value;
+    iface->iter_next = chan_model_iter_next;
+    iface->iter_children = chan_model_iter_children;
+    iface->iter_has_child = chan_model_iter_has_child;
+    iface->iter_n_children = chan_model_iter_n_children;
+    iface->iter_nth_child = chan_model_iter_nth_child;
+    iface->iter_parent = chan_model_iter_parent;
+}
+
+// places the entries of the group in rows according to 'chan_order' (without telling the view)
+void chan_model_place(ChanModel* model, uint32_t num_entries)
+{
+    playlist_group_t* group = &playlist.groups[model->group];
+
+    for (; model->num_seen < num_entries; model->num_seen++)
+    {
+        if (chan_order == CHAN_ORDER_ALIVE && entry_is_dead(&group->entries[model->num_seen]))
+            continue;
+
+        if (model->rows != NULL)
+        {
+            playlist_ref_t* rows = (playlist_ref_t*)playlist_grow(model->rows, sizeof(playlist_ref_t), model->num_rows, &model->max_rows);
+            if (rows == NULL)
+                break;
+
+            model->rows = rows;
+            model->rows[model->num_rows] = (playlist_ref_t) { .group = model->group, .entry = model->num_seen };
+        }
+
+        model->num_rows++;
+    }
+}
+
+// channels answering first are listed first, those not probed yet after them and the dead ones last
+gint chan_model_compare_health(gconstpointer a, gconstpointer b, gpointer data)
+{
+    const playlist_entry_t* entries = (const playlist_entry_t*)data;
+    uint32_t ia = ((const playlist_ref_t*)a)->entry;
+    uint32_t ib = ((const playlist_ref_t*)b)->entry;
+
+    int rank_a = entry_is_dead(&entries[ia]) ? 2 : (entries[ia].status == 0);
+    int rank_b = entry_is_dead(&entries[ib]) ? 2 : (entries[ib].status == 0);
+
+    if (rank_a != rank_b)
+        return rank_a - rank_b;
+
+    if (rank_a == 0 && entries[ia].latency_ms != entries[ib].latency_ms)
+        return entries[ia].latency_ms - entries[ib].latency_ms;
+
+    return (ia > ib) - (ia < ib); // otherwise keep the playlist order
+}
+
+// tells the view about entries appended to the group after it was set (the playlist may still be loading)
+void chan_model_sync(ChanModel* model)
+{
+    if (model->group < 0 || model->group >= playlist.num_groups)
+        return;
+
+    uint32_t first = model->num_rows;
+    chan_model_place(model, playlist.groups[model->group].num_entries);
+
+    for (uint32_t row = first; row < model->num_rows; row++)
+    {
+        GtkTreeIter iter;
+        chan_model_make_iter(model, &iter, row);
+
+        GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+        gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+        gtk_tree_path_free(path);
+    }
+}
+
+// replaces all rows: the model is detached from the view meanwhile, so no per-row signals are emitted
+void chan_model_set_group(ChanModel* model, GtkTreeView* view, int group)
+{
+    gtk_tree_view_set_model(view, NULL);
+
+    model->stamp++;
+    model->group = (group < playlist.num_groups) ? group : -1;
+    model->num_rows = 0;
+    model->num_seen = 0;
+
+    free(model->rows);
+    model->rows = NULL;
+    model->max_rows = 0;
+
+    if (model->group >= 0)
+    {
+        playlist_group_t* g = &playlist.groups[model->group];
+
+        if (chan_order != CHAN_ORDER_PLAYLIST)
+        {
+            // rows are mapped to entries - room for the whole group, more are added as it grows
+            model->max_rows = MAX(g->num_entries, 8);
+
+            if ((model->rows = (playlist_ref_t*)malloc(model->max_rows * sizeof(playlist_ref_t))) == NULL)
+                model->max_rows = 0;
+        }
+
+        chan_model_place(model, g->num_entries);
+
+        if (chan_order == CHAN_ORDER_HEALTH && model->rows != NULL)
+            g_qsort_with_data(model->rows, model->num_rows, sizeof(playlist_ref_t), chan_model_compare_health, g->entries);
+    }
+
+    gtk_tree_view_set_model(view, GTK_TREE_MODEL(model));
+}
+
+// shows the given entries (e.g. search results) instead of a group - the model takes the array
+void chan_model_set_rows(ChanModel* model, GtkTreeView* view, playlist_ref_t* rows, uint32_t num_rows)
+{
+    gtk_tree_view_set_model(view, NULL);
+
+    free(model->rows);
+
+    model->stamp++;
+    model->group = CHAN_GROUP_RESULTS;
+    model->rows = rows;
+    model->num_rows = (rows == NULL) ? 0 : num_rows;
+    model->num_seen = 0;
+    model->max_rows = num_rows;
+
+    gtk_tree_view_set_model(view, GTK_TREE_MODEL(model));
+}
+
+// lists the group again in the current order, keeping the selected channel selected
+void chan_model_reorder(ChanModel* model, GtkTreeView* view)
+{
+    if (model->group < 0)
+        return;
+
+    chan_model_set_group(model, view, model->group);
+
+    int row = chan_model_row_of(model, selected_group, selected_channel);
+    if (row < 0)
+        return;
+
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    gtk_tree_view_set_cursor(view, path, NULL, FALSE);
+    gtk_tree_path_free(path);
+}
+
+// redraws the row of the entry after it was probed
+void chan_model_entry_changed(ChanModel* model, int group, int entry)
+{
+    GtkTreeIter iter;
+
+    int row = chan_model_row_of(model, group, entry);
+    if (row < 0 || !chan_model_make_iter(model, &iter, row))
+        return;
+
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+// redraws the visible rows which use this logo (many channels may share the same one)
+void chan_model_logo_changed(ChanModel* model, GtkTreeView* view, const char* logo)
+{
+    GtkTreePath *start, *end;
+
+    if (model->num_rows == 0 || !gtk_tree_view_get_visible_range(view, &start, &end))
+        return;
+
+    gint first = gtk_tree_path_get_indices(start)[0];
+    gint last = gtk_tree_path_get_indices(end)[0];
+
+    for (gint row = first; row <= last; row++)
+    {
+        GtkTreeIter iter;
+
+        if (!chan_model_make_iter(model, &iter, row))
+            continue;
+
+        playlist_ref_t ref = chan_model_ref(model, row);
+        if (strcmp(playlist.groups[ref.group].entries[ref.entry].logo, logo) != 0)
+            continue;
+
+        GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+        gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+        gtk_tree_path_free(path);
+    }
+
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+}
+
+// =====================================
+// STREAM PROBER
+// =====================================
+
+// checks in background whether the channels of the selected group answer, and how fast,
+// opening only a few connections at a time so the uplink is not saturated
+#define PROBE_CONCURRENCY   8
+#define PROBE_TIMEOUT       8   // seconds
+#define PROBE_RANGE         "0-1023"
+
+int probe_rate = 10; // probes started per second - 0 disables the prober
+
+typedef struct probe_job {
+    uint32_t batch;     // probe_group call which queued it
+    int group;
+    int entry;
+    char* url;
+    CURL* curl;
+    int16_t status;
+    uint16_t latency_ms;
+} probe_job_t;
+
+static GMutex probe_lock;
+static GCond probe_cond;
+static GQueue probe_pending = G_QUEUE_INIT;
+static GThread* probe_thread;
+static int probe_quit;
+
+static uint32_t probe_batch;        // last batch queued (GTK thread only)
+static int probe_outstanding;       // results of that batch still expected
+
+void probe_job_free(probe_job_t* job)
+{
+    free(job->url);
+    free(job);
+}
+
+// the first bytes are enough to know the stream answers
+size_t probe_curl_write(char* data, size_t size, size_t nmemb, void* user)
+{
+    return 0;
+}
+
+// back in the GTK thread: records the result in the entry
+gboolean probe_job_done(gpointer data)
+{
+    probe_job_t* job = (probe_job_t*)data;
+
+    if (job->group < playlist.num_groups && job->entry < playlist.groups[job->group].num_entries)
+    {
+        playlist_entry_t* entry = &playlist.groups[job->group].entries[job->entry];
+
+        // a refresh may have removed the entry or replaced its url meanwhile
+        if (entry->status != PLAYLIST_ENTRY_REMOVED && strcmp(entry->url, job->url) == 0)
+        {
+            entry->status = job->status;
+            entry->latency_ms = job->latency_ms;
+
+            chan_model_entry_changed(chan_model, job->group, job->entry);
+        }
+    }
+
+    // the whole group was probed: list it again if sorted or filtered by health
+    // results of earlier batches (even of the same group) are not counted
+    if (job->batch == probe_batch && probe_outstanding > 0 && --probe_outstanding == 0)
+        if (chan_order != CHAN_ORDER_PLAYLIST && chan_model->group == job->group)
+            chan_model_reorder(chan_model, chan_tree);
+
+    probe_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+void probe_start(CURLM* multi, probe_job_t* job)
+{
+    job->curl = curl_easy_init();
+    if (job->curl == NULL)
+    {
+        job->status = -1;
+        g_idle_add(probe_job_done, job);
+        return;
+    }
+
+    curl_easy_setopt(job->curl, CURLOPT_URL, job->url);
+    curl_easy_setopt(job->curl, CURLOPT_USERAGENT, http_user_agent);
+    curl_easy_setopt(job->curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(job->curl, CURLOPT_RANGE, PROBE_RANGE);
+    curl_easy_setopt(job->curl, CURLOPT_TIMEOUT, (long)PROBE_TIMEOUT);
+    curl_easy_setopt(job->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(job->curl, CURLOPT_WRITEFUNCTION, probe_curl_write);
+    curl_easy_setopt(job->curl, CURLOPT_PRIVATE, job);
+
+    curl_multi_add_handle(multi, job->curl);
+}
+
+void probe_finish(CURLM* multi, CURLMsg* msg)
+{
+    probe_job_t* job;
+    long code = 0;
+    double seconds = 0;
+
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&job);
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_STARTTRANSFER_TIME, &seconds);
+
+    // the transfer is aborted on purpose as soon as data arrives
+    int answered = (msg->data.result == CURLE_OK || msg->data.result == CURLE_WRITE_ERROR) && code > 0;
+
+    job->status = answered ? (int16_t)code : -1;
+    job->latency_ms = (seconds * 1000 > UINT16_MAX) ? UINT16_MAX : (uint16_t)(seconds * 1000);
+
+    curl_multi_remove_handle(multi, job->curl);
+    curl_easy_cleanup(job->curl);
+    job->curl = NULL;
+
+    g_idle_add(probe_job_done, job);
+}
+
+gpointer probe_worker(gpointer data)
+{
+    CURLM* multi = curl_multi_init();
+    gint64 next_start = 0;
+    int running = 0;
+
+    for (;;)
+    {
+        g_mutex_lock(&probe_lock);
+
+        while (!probe_quit && running == 0 && g_queue_is_empty(&probe_pending))
+            g_cond_wait(&probe_cond, &probe_lock);
+
+        if (probe_quit)
+        {
+            g_mutex_unlock(&probe_lock);
+            break;
+        }
+
+        // start new probes, at most 'probe_rate' per second
+        gint64 now = g_get_monotonic_time();
+
+        while (running < PROBE_CONCURRENCY && now >= next_start && !g_queue_is_empty(&probe_pending))
+        {
+            probe_start(multi, (probe_job_t*)g_queue_pop_head(&probe_pending));
+            next_start = now + G_USEC_PER_SEC / probe_rate;
+            running++;
+        }
+
+        g_mutex_unlock(&probe_lock);
+
+        if (running == 0)
+        {
+            g_usleep(next_start - now); // only waiting for the rate limit
+            continue;
+        }
+
+        int still_running;
+        curl_multi_perform(multi, &still_running);
+
+        CURLMsg* msg;
+        int msgs_left;
+
+        while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL)
+            if (msg->msg == CURLMSG_DONE)
+            {
+                probe_finish(multi, msg);
+                running--;
+            }
+
+        curl_multi_wait(multi, NULL, 0, 1000 / probe_rate + 1, NULL);
+    }
+
+    curl_multi_cleanup(multi);
+    return NULL;
+}
+
+void probe_init()
+{
+    if (probe_rate > 0)
+        probe_thread = g_thread_new("probe", probe_worker, NULL);
+}
+
+// queues the entries of the group not probed yet, dropping the queued probes of the previous group
+void probe_group(int group)
+{
+    if (probe_thread == NULL || group >= playlist.num_groups)
+        return;
+
+    g_mutex_lock(&probe_lock);
+
+    while (!g_queue_is_empty(&probe_pending))
+        probe_job_free((probe_job_t*)g_queue_pop_head(&probe_pending));
+
+    probe_batch++;
+    probe_outstanding = 0;
+
+    playlist_group_t* g = &playlist.groups[group];
+
+    for (uint32_t e = 0; e < g->num_entries; e++)
+    {
+        if (g->entries[e].status != 0 || !playlist_is_url(g->entries[e].url))
+            continue;
+
+        probe_job_t* job = (probe_job_t*)calloc(1, sizeof(probe_job_t));
+        if (job == NULL)
+            break;
+
+        job->batch = probe_batch;
+        job->group = group;
+        job->entry = e;
+        job->url = strdup(g->entries[e].url);
+
+        g_queue_push_tail(&probe_pending, job);
+        probe_outstanding++;
+    }
+
+    g_cond_signal(&probe_cond);
+    g_mutex_unlock(&probe_lock);
+}
+
+// probes in flight are abandoned: their results could no longer be shown
+void probe_shutdown()
+{
+    if (probe_thread == NULL)
+        return;
+
+    g_mutex_lock(&probe_lock);
+    probe_quit = 1;
+    g_cond_signal(&probe_cond);
+    g_mutex_unlock(&probe_lock);
+
+    g_thread_join(probe_thread);
+    probe_thread = NULL;
+}
+
+// =====================================
+// FAVOURITES AND HISTORY
+// =====================================
+
+// channels marked as favourites and the last ones watched, listed at the top of the categories
+// they are remembered by tvg-id and name, as in PLAYLIST UPDATE, so they are found again when the provider
+// changes their urls - stored in cache/history as lines "<F|R>\t<tvg-id>\t<name>"
+#define HISTORY_MAX_RECENT  20
+
+enum { HISTORY_FAVOURITES, HISTORY_RECENT, HISTORY_NUM_LISTS };
+
+static const char* const history_titles[HISTORY_NUM_LISTS] = { "★ Favoritos", "Vistos recentemente" };
+static const char history_kinds[HISTORY_NUM_LISTS] = { 'F', 'R' };
+
+typedef struct history_item {
+    char* id;
+    char* name;
+    uint32_t hash;              // of 'id' and 'name'
+    playlist_ref_t ref;         // where it is in the playlist - group is UINT32_MAX if it was not found
+    struct history_item* next;  // next item with the same hash in 'history_index'
+} history_item_t;
+
+static GPtrArray* history_lists[HISTORY_NUM_LISTS]; // history_item_t, most recent first
+static GHashTable* history_index;   // hash => first history_item_t - finds the items of an entry in O(1)
+static int history_shown = -1;      // list shown in 'chan_tree' - -1 if none
+
+uint32_t history_hash(const char* id, const char* name)
+{
+    return playlist_hash(id, strlen(id)) * 31 + playlist_hash(name, strlen(name));
+}
+
+void history_item_free(gpointer data)
+{
+    history_item_t* item = (history_item_t*)data;
+
+    g_free(item->id);
+    g_free(item->name);
+    g_free(item);
+}
+
+history_item_t* history_item_new(const char* id, const char* name, playlist_ref_t ref)
+{
+    history_item_t* item = g_new(history_item_t, 1);
+
+    *item = (history_item_t) {
+        .id = g_strdup(id),
+        .name = g_strdup(name),
+        .hash = history_hash(id, name),
+        .ref = ref,
+        .next = NULL,
+    };
+
+    return item;
+}
+
+// the lists are short, so the index is simply built again whenever they change
+void history_index_build()
+{
+    g_hash_table_remove_all(history_index);
+
+    for (int list = 0; list < HISTORY_NUM_LISTS; list++)
+        for (guint i = 0; i < history_lists[list]->len; i++)
+        {
+            history_item_t* item = (history_item_t*)g_ptr_array_index(history_lists[list], i);
+
+            item->next = (history_item_t*)g_hash_table_lookup(history_index, GUINT_TO_POINTER(item->hash));
+            g_hash_table_insert(history_index, GUINT_TO_POINTER(item->hash), item);
+        }
+}
+
+// position of the entry in the list - -1 if not there
+int history_find(int list, const playlist_entry_t* entry)
+{
+    for (guint i = 0; i < history_lists[list]->len; i++)
+    {
+        history_item_t* item = (history_item_t*)g_ptr_array_index(history_lists[list], i);
+
+        if (strcmp(item->id, entry->id) == 0 && strcmp(item->name, entry->name) == 0)
+            return (int)i;
+    }
+
+    return -1;
+}
+
+void history_save()
+{
+    char file_name[256], temp_name[256];
+    snprintf(file_name, sizeof(file_name), "%s/history", cache_dir);
+    snprintf(temp_name, sizeof(temp_name), "%s/history.%d", cache_dir, (int)getpid());
+    mkdir(cache_dir, 0777); // may already exist
+
+    FILE* fp;
+    if ((fp = fopen(temp_name, "w")) == NULL)
+    {
+        fprintf(stderr, "\nCannot save %s: %d %s\n", file_name, errno, strerror(errno));
+        return;
+    }
+
+    for (int list = 0; list < HISTORY_NUM_LISTS; list++)
+        for (guint i = 0; i < history_lists[list]->len; i++)
+        {
+            history_item_t* item = (history_item_t*)g_ptr_array_index(history_lists[list], i);
+            fprintf(fp, "%c\t%s\t%s\n", history_kinds[list], item->id, item->name);
+        }
+
+    if (fclose(fp) != 0 || rename(temp_name, file_name) != 0)
+    {
+        fprintf(stderr, "\nCannot save %s: %d %s\n", file_name, errno, strerror(errno));
+        remove(temp_name);
+    }
+}
+
+void history_init()
+{
+    history_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (int list = 0; list < HISTORY_NUM_LISTS; list++)
+        history_lists[list] = g_ptr_array_new_with_free_func(history_item_free);
+
+    char file_name[256];
+    snprintf(file_name, sizeof(file_name), "%s/history", cache_dir);
+
+    FILE* fp;
+    if ((fp = fopen(file_name, "r")) == NULL)
+        return; // nothing watched yet
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        // kind, tvg-id and name separated by tabs
+        char* id = strchr(line, '\t');
+        char* name = (id == NULL) ? NULL : strchr(id + 1, '\t');
+        if (name == NULL)
+            continue;
+
+        *id++ = '\0';
+        *name++ = '\0';
+
+        for (int list = 0; list < HISTORY_NUM_LISTS; list++)
+            if (line[0] == history_kinds[list] && line[1] == '\0')
+                g_ptr_array_add(history_lists[list], history_item_new(id, name, (playlist_ref_t) { .group = UINT32_MAX }));
+    }
+
+    fclose(fp);
+    history_index_build();
+}
+
+// finds the entries of the items in the playlist - once it is loaded or refreshed
+void history_resolve()
+{
+    if (g_hash_table_size(history_index) == 0)
+        return;
+
+    TRACE_BEGIN(start);
+
+    for (int list = 0; list < HISTORY_NUM_LISTS; list++)
+        for (guint i = 0; i < history_lists[list]->len; i++)
+            ((history_item_t*)g_ptr_array_index(history_lists[list], i))->ref.group = UINT32_MAX;
+
+    for (uint32_t g = 0; g < playlist.num_groups; g++)
+        for (uint32_t e = 0; e < playlist.groups[g].num_entries; e++)
+        {
+            playlist_entry_t* entry = &playlist.groups[g].entries[e];
+
+            if (entry->status == PLAYLIST_ENTRY_REMOVED)
+                continue;
+
+            history_item_t* item = (history_item_t*)g_hash_table_lookup(history_index, GUINT_TO_POINTER(history_hash(entry->id, entry->name)));
+
+            for (; item != NULL; item = item->next)
+                if (item->ref.group == UINT32_MAX && strcmp(item->id, entry->id) == 0 && strcmp(item->name, entry->name) == 0)
+                    item->ref = (playlist_ref_t) { .group = g, .entry = e }; // the first one, if there are duplicates
+        }
+
+    TRACE_END("history_resolve", start);
+}
+
+// lists the channels of the list which are in the playlist
+void history_show(int list)
+{
+    GPtrArray* items = history_lists[list];
+    playlist_ref_t* rows = (playlist_ref_t*)malloc((items->len + 1) * sizeof(playlist_ref_t));
+    uint32_t num_rows = 0;
+
+    if (rows == NULL)
+        return;
+
+    for (guint i = 0; i < items->len; i++)
+    {
+        playlist_ref_t ref = ((history_item_t*)g_ptr_array_index(items, i))->ref;
+
+        if (ref.group < playlist.num_groups && ref.entry < playlist.groups[ref.group].num_entries
+            && playlist.groups[ref.group].entries[ref.entry].status != PLAYLIST_ENTRY_REMOVED)
+            rows[num_rows++] = ref;
+    }
+
+    logo_pipeline_cancel();
+    chan_model_set_rows(chan_model, chan_tree, rows, num_rows);
+    history_shown = list;
+}
+
+// the channel goes to the top of the list - or is removed, if 'toggle' and it is already there
+void history_add(int list, int group, int entry, int toggle)
+{
+    if (group < 0 || group >= (int)playlist.num_groups || entry < 0 || entry >= (int)playlist.groups[group].num_entries)
+        return;
+
+    playlist_entry_t* e = &playlist.groups[group].entries[entry];
+    GPtrArray* items = history_lists[list];
+    int found = history_find(list, e);
+
+    if (found == 0 && !toggle)
+        return; // already the first - nothing to save
+
+    if (found >= 0)
+        g_ptr_array_remove_index(items, found);
+
+    if (found < 0 || !toggle)
+    {
+        g_ptr_array_insert(items, 0, history_item_new(e->id, e->name, (playlist_ref_t) { .group = group, .entry = entry }));
+
+        if (list == HISTORY_RECENT && items->len > HISTORY_MAX_RECENT)
+            g_ptr_array_remove_index(items, items->len - 1);
+    }
+
+    history_index_build();
+    history_save();
+
+    // the recent list is not reordered under the user while zapping through it
+    if (history_shown == list && list == HISTORY_FAVOURITES)
+        history_show(list);
+}
+
+// =====================================
+// CHANNEL CANDIDATES
+// =====================================
+
+// providers list the same channel several times (other servers or qualities), and merged sources add
+// their own copies as the alternates of the playlist: entries with the same tvg-id - or if they have none,
+// the same name without the quality (HD, SD...) - are candidates to play one channel, see FAILOVER
+// how fast each one started is kept across sessions in cache/candidates as lines
+// "<url hash>\t<starts>\t<failures>\t<average ms>" - the query of the url, with its tokens, is not hashed
+#define CANDIDATES_MAX          8
+#define CANDIDATES_ALTERNATE    UINT32_MAX  // group of the refs into 'playlist.alternates'
+#define CANDIDATES_SEED         0xcbf29ce484222325ull
+
+typedef struct candidate_key {
+    uint64_t hash;      // of the tvg-id or the normalized name
+    playlist_ref_t ref;
+} candidate_key_t;
+
+static candidate_key_t* candidate_keys; // sorted by hash - only the channels listed more than once
+static uint32_t candidate_num_keys;
+
+typedef struct candidate_stat {
+    gint64 url_hash;
+    uint32_t starts;
+    uint32_t failures;      // errors and timeouts
+    uint32_t average_ms;    // to the first frame, recent starts weigh more
+} candidate_stat_t;
+
+static GHashTable* candidate_stats; // url_hash => candidate_stat_t
+static guint candidates_save_timer; // changes not saved yet
+
+#define CANDIDATES_SAVE_DELAY   30  // seconds
+
+static const char* const candidate_qualities[] = { "sd", "hd", "fhd", "uhd", "4k", "hq", "hevc", "h264", "h265", "720p", "1080p", "2160p" };
+
+static uint64_t candidate_hash(uint64_t hash, const char* str, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t)str[i]) * 0x100000001b3ull; // FNV-1a
+
+    return hash;
+}
+
+static int candidate_word_char(char c)
+{
+    return isalnum((unsigned char)c) || (unsigned char)c >= 0x80; // accented letters are part of the words
+}
+
+// "ESPN 2 HD" and "espn 2 [FHD]" are the same channel - 0 if there is nothing to tell it by
+uint64_t candidate_key_hash(const playlist_entry_t* entry)
+{
+    if (entry->id[0] != '\0')
+        return candidate_hash(CANDIDATES_SEED, entry->id, strlen(entry->id));
+
+    uint64_t hash = candidate_hash(CANDIDATES_SEED, "\t", 1); // names never match tvg-ids
+    const char* c = entry->name;
+    int words = 0;
+
+    for (;;)
+    {
+        while (*c != '\0' && !candidate_word_char(*c))
+            c++;
+
+        const char* word = c;
+        while (candidate_word_char(*c))
+            c++;
+
+        size_t len = c - word;
+        if (len == 0)
+            break;
+
+        char lower[8];
+        int quality = 0;
+
+        if (len < sizeof(lower))
+        {
+            for (size_t i = 0; i < len; i++)
+                lower[i] = tolower((unsigned char)word[i]);
+
+            lower[len] = '\0';
+
+            for (size_t q = 0; q < G_N_ELEMENTS(candidate_qualities) && !quality; q++)
+                quality = (strcmp(lower, candidate_qualities[q]) == 0);
+        }
+
+        if (quality)
+            continue;
+
+        words++;
+        for (size_t i = 0; i < len; i++)
+            hash = (hash ^ (uint8_t)tolower((unsigned char)word[i])) * 0x100000001b3ull;
+
+        hash = (hash ^ ' ') * 0x100000001b3ull; // "ab c" is not "a bc"
+    }
+
+    return (words == 0) ? 0 : hash;
+}
+
+playlist_entry_t* candidate_entry(playlist_ref_t ref)
+{
+    return (ref.group == CANDIDATES_ALTERNATE) ? &playlist.alternates.entries[ref.entry] : &playlist.groups[ref.group].entries[ref.entry];
+}
+
+// by hash, and the listed entries before the alternates
+int candidate_key_compare(const void* a, const void* b)
+{
+    const candidate_key_t* ka = (const candidate_key_t*)a;
+    const candidate_key_t* kb = (const candidate_key_t*)b;
+
+    if (ka->hash != kb->hash)
+        return (ka->hash < kb->hash) ? -1 : 1;
+
+    if (ka->ref.group != kb->ref.group)
+        return (ka->ref.group < kb->ref.group) ? -1 : 1;
+
+    return (ka->ref.entry < kb->ref.entry) ? -1 : (ka->ref.entry > kb->ref.entry);
+}
+
+// once the playlist is loaded or refreshed
+void candidates_build()
+{
+    TRACE_BEGIN(start);
+
+    uint64_t total = playlist.alternates.num_entries;
+    for (uint32_t g = 0; g < playlist.num_groups; g++)
+        total += playlist.groups[g].num_entries;
+
+    candidate_key_t* keys = (candidate_key_t*)malloc((total + 1) * sizeof(candidate_key_t));
+    if (keys == NULL)
+        return;
+
+    uint32_t n = 0;
+
+    for (uint32_t g = 0; g <= playlist.num_groups; g++)
+    {
+        const playlist_group_t* gro = (g == playlist.num_groups) ? &playlist.alternates : &playlist.groups[g];
+
+        for (uint32_t e = 0; e < gro->num_entries; e++)
+        {
+            uint64_t hash = (gro->entries[e].status == PLAYLIST_ENTRY_REMOVED) ? 0 : candidate_key_hash(&gro->entries[e]);
+
+            if (hash != 0)
+                keys[n++] = (candidate_key_t) {
+                    .hash = hash,
+                    .ref = { .group = (g == playlist.num_groups) ? CANDIDATES_ALTERNATE : g, .entry = e },
+                };
+        }
+    }
+
+    qsort(keys, n, sizeof(candidate_key_t), candidate_key_compare);
+
+    // channels listed once have no other candidate
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0, j; i < n; i = j)
+    {
+        for (j = i + 1; j < n && keys[j].hash == keys[i].hash; j++)
+            ;
+
+        if (j - i > 1)
+        {
+            memmove(&keys[kept], &keys[i], (j - i) * sizeof(candidate_key_t));
+            kept += j - i;
+        }
+    }
+
+    free(candidate_keys);
+    candidate_keys = keys;
+    candidate_num_keys = kept;
+
+    TRACE_END("candidates_build", start);
+}
+
+candidate_stat_t* candidate_stat(const char* url, int add)
+{
+    gint64 url_hash = (gint64)candidate_hash(CANDIDATES_SEED, url, strcspn(url, "?"));
+    candidate_stat_t* stat = (candidate_stat_t*)g_hash_table_lookup(candidate_stats, &url_hash);
+
+    if (stat == NULL && add)
+    {
+        stat = g_new0(candidate_stat_t, 1);
+        stat->url_hash = url_hash;
+        g_hash_table_insert(candidate_stats, &stat->url_hash, stat);
+    }
+
+    return stat;
+}
+
+// expected time to the first frame: a failure costs as much as waiting for the timeout
+double candidate_score(const playlist_entry_t* entry, double timeout_ms)
+{
+    const candidate_stat_t* stat = candidate_stat(entry->url, 0);
+    uint32_t tries = (stat == NULL) ? 0 : stat->starts + stat->failures;
+
+    // not tried yet: after those which start fast, before those which fail
+    double score = (tries == 0) ? timeout_ms / 2 : ((double)stat->starts * stat->average_ms + (double)stat->failures * timeout_ms) / tries;
+
+    if (entry->status == -1 || entry->status >= 400) // the prober could not get it
+        score += timeout_ms;
+
+    return score;
+}
+
+// the candidates of the channel, the most likely to start fast first - returns how many (at least the channel itself)
+int candidates_of(int group, int entry, playlist_ref_t* candidates, double timeout_ms)
+{
+    const playlist_entry_t* requested = &playlist.groups[group].entries[entry];
+    uint64_t hash = candidate_key_hash(requested);
+
+    candidates[0] = (playlist_ref_t) { .group = group, .entry = entry };
+    int num = 1;
+
+    if (hash == 0)
+        return num;
+
+    // first key with the hash
+    uint32_t lo = 0, hi = candidate_num_keys;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (candidate_keys[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (uint32_t k = lo; k < candidate_num_keys && candidate_keys[k].hash == hash && num < CANDIDATES_MAX; k++)
+    {
+        playlist_ref_t ref = candidate_keys[k].ref;
+
+        if ((ref.group != (uint32_t)group || ref.entry != (uint32_t)entry) && candidate_entry(ref)->status != PLAYLIST_ENTRY_REMOVED)
+            candidates[num++] = ref;
+    }
+
+    // insertion sort: among equals (e.g. none tried yet) the one requested stays first
+    double scores[CANDIDATES_MAX];
+    for (int c = 0; c < num; c++)
+        scores[c] = candidate_score(candidate_entry(candidates[c]), timeout_ms);
+
+    for (int c = 1; c < num; c++)
+    {
+        playlist_ref_t ref = candidates[c];
+        double score = scores[c];
+        int d = c;
+
+        for (; d > 0 && scores[d - 1] > score; d--)
+        {
+            candidates[d] = candidates[d - 1];
+            scores[d] = scores[d - 1];
+        }
+
+        candidates[d] = ref;
+        scores[d] = score;
+    }
+
+    return num;
+}
+
+void candidates_save()
+{
+    char file_name[256], temp_name[256];
+    snprintf(file_name, sizeof(file_name), "%s/candidates", cache_dir);
+    snprintf(temp_name, sizeof(temp_name), "%s/candidates.%d", cache_dir, (int)getpid());
+    mkdir(cache_dir, 0777); // may already exist
+
+    FILE* fp;
+    if ((fp = fopen(temp_name, "w")) == NULL)
+    {
+        fprintf(stderr, "\nCannot save %s: %d %s\n", file_name, errno, strerror(errno));
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, candidate_stats);
+
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        const candidate_stat_t* stat = (const candidate_stat_t*)value;
+        fprintf(fp, "%016" PRIx64 "\t%u\t%u\t%u\n", (uint64_t)stat->url_hash, stat->starts, stat->failures, stat->average_ms);
+    }
+
+    if (fclose(fp) != 0 || rename(temp_name, file_name) != 0)
+    {
+        fprintf(stderr, "\nCannot save %s: %d %s\n", file_name, errno, strerror(errno));
+        remove(temp_name);
+    }
+}
+
+gboolean candidates_save_tick(gpointer data)
+{
+    candidates_save_timer = 0;
+    candidates_save();
+    return G_SOURCE_REMOVE;
+}
+
+// time to the first frame of the candidate, or -1 if it failed
+void candidate_record(const char* url, int64_t start_us)
+{
+    candidate_stat_t* stat = candidate_stat(url, 1);
+
+    if (start_us < 0)
+        stat->failures++;
+    else
+    {
+        uint32_t ms = (uint32_t)MIN(start_us / 1000, (int64_t)UINT32_MAX);
+        stat->average_ms = (stat->starts == 0) ? ms : (stat->average_ms * 3 + ms) / 4;
+        stat->starts++;
+    }
+
+    // old sessions fade away
+    if (stat->starts + stat->failures > 100)
+    {
+        stat->starts = (stat->starts + 1) / 2;
+        stat->failures = (stat->failures + 1) / 2;
+    }
+
+    // written a while later, with the other starts meanwhile (e.g. of the zap pool)
+    if (candidates_save_timer == 0)
+        candidates_save_timer = g_timeout_add_seconds(CANDIDATES_SAVE_DELAY, candidates_save_tick, NULL);
+}
+
+// at exit: the changes not saved yet
+void candidates_flush()
+{
+    if (candidates_save_timer == 0)
+        return;
+
+    g_source_remove(candidates_save_timer);
+    candidates_save_timer = 0;
+    candidates_save();
+}
+
+void candidates_init()
+{
+    candidate_stats = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+
+    char file_name[256];
+    snprintf(file_name, sizeof(file_name), "%s/candidates", cache_dir);
+
+    FILE* fp;
+    if ((fp = fopen(file_name, "r")) == NULL)
+        return; // nothing played yet
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        uint64_t url_hash;
+        uint32_t starts, failures, average_ms;
+
+        if (sscanf(line, "%" SCNx64 "\t%u\t%u\t%u", &url_hash, &starts, &failures, &average_ms) != 4)
+            continue;
+
+        candidate_stat_t* stat = g_new(candidate_stat_t, 1);
+        *stat = (candidate_stat_t) { .url_hash = (gint64)url_hash, .starts = starts, .failures = failures, .average_ms = average_ms };
+        g_hash_table_replace(candidate_stats, &stat->url_hash, stat);
+    }
+
+    fclose(fp);
+}
+
+// =====================================
+// GUI
+// =====================================
+
+void player_realize(GtkWidget* wid, gpointer data)
+{
+}
+
+void destroy(GtkWidget *widget, gpointer data) {
+    gtk_main_quit();
+}
+
+// the whole playlist is available: index it and load its guide
+void playlist_loaded()
+{
+    TRACE_BEGIN(start);
+    search_index_build(&search_index, &playlist);
+    TRACE_END("search_index_build", start);
+
+    epg_start();
+    history_resolve();
+    candidates_build();
+}
+
+// appends the groups which are not yet in the list (the playlist may still be loading)
+void fill_groups_list()
+{
+    GtkTreeIter group_iter;
+    static GtkTreeStore *cat_store;
+    static uint32_t groups_shown;
+
+    if (cat_store == NULL)
+        cat_store = GTK_TREE_STORE(gtk_builder_get_object(builder, "cat_store"));
+
+    TRACE_BEGIN(start);
+
+    // favourites and recently watched come first - see FAVOURITES AND HISTORY
+    static int history_rows;
+    for (; history_rows < HISTORY_NUM_LISTS; history_rows++)
+    {
+        gtk_tree_store_append(cat_store, &group_iter, NULL);
+        gtk_tree_store_set(cat_store, &group_iter, 0, history_titles[history_rows], -1);
+    }
+
+    for (uint32_t group_index = groups_shown; group_index < playlist.num_groups; group_index++, groups_shown++)
+    {
+        gtk_tree_store_append(cat_store, &group_iter, NULL);
+        gtk_tree_store_set(cat_store, &group_iter, 0, playlist.groups[group_index].group_name, -1);
+    }
+
+    TRACE_END("fill_groups_list", start);
+
+    logo_prefetch_schedule();
+}
+
+// appends the channels of the group which are not yet in the list (the playlist may still be loading)
+void update_channel_list()
+{
+    chan_model_sync(chan_model);
+}
+
+void fill_channel_list()
+{
+    TRACE_BEGIN(start);
+
+    // logos of the previous category are not needed anymore
+    logo_pipeline_cancel();
+    chan_model_set_group(chan_model, chan_tree, selected_group);
+    history_shown = -1;
+    probe_group(selected_group);
+
+    logo_prefetch_visited(selected_group);
+    logo_prefetch_schedule();
+
+    TRACE_END("fill_channel_list", start);
+}
+
+int selection_index(GtkTreeSelection* selection)
+{
+    GtkTreeIter iter;
+    GtkTreeModel *model;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+        return 0;
+
+    GtkTreePath* path = gtk_tree_model_get_path(model, &iter);
+    int index = gtk_tree_path_get_indices(path)[0];
+    gtk_tree_path_free(path);
+
+    return index;
+}
+
+// the signal handlers get the selection of the tree
+int get_sel_index(GtkWidget *c)
+{
+    return selection_index(GTK_TREE_SELECTION(c));
+}
+
+// the first rows of the categories are the lists of FAVOURITES AND HISTORY
+void cat_row_show(int row)
+{
+    if (row < HISTORY_NUM_LISTS)
+    {
+        history_show(row);
+        return;
+    }
+
+    selected_group = row - HISTORY_NUM_LISTS;
+    fill_channel_list();
+}
+
+void cat_sel_change(GtkWidget *c)
+{
+    cat_row_show(get_sel_index(c));
+}
+
+void chan_sel_change(GtkWidget *c)
+{
+    // search results may come from any group
+    playlist_ref_t ref = chan_model_ref(chan_model, get_sel_index(c));
+
+    if (ref.group >= playlist.num_groups || ref.entry >= playlist.groups[ref.group].num_entries)
+        return;
+
+    selected_group = ref.group;
+    selected_channel = ref.entry;
+
+    printf("channel = %s\n", playlist.groups[selected_group].entries[selected_channel].name);
+}
+
+#define SEARCH_MAX_RESULTS 1000
+
+// lists the channels of every group matching the text typed, or the selected category if it was erased
+void search_changed(GtkSearchEntry* entry, gpointer data)
+{
+    const char* query = gtk_entry_get_text(GTK_ENTRY(entry));
+
+    if (query[0] == '\0')
+    {
+        cat_row_show(selection_index(gtk_tree_view_get_selection(cat_tree)));
+        return;
+    }
+
+    playlist_ref_t* results = (playlist_ref_t*)malloc(SEARCH_MAX_RESULTS * sizeof(playlist_ref_t));
+    if (results == NULL)
+        return;
+
+    TRACE_BEGIN(start);
+    uint32_t num_results = search_index_find(&search_index, query, results, SEARCH_MAX_RESULTS);
+    TRACE_END("search", start);
+
+    logo_pipeline_cancel();
+    chan_model_set_rows(chan_model, chan_tree, results, num_results);
+    history_shown = -1;
+}
+
+gboolean search_key(GtkWidget* widget, GdkEventKey *event, gpointer data)
+{
+    switch (event->keyval)
+    {
+        case GDK_KEY_Down:
+        case GDK_KEY_Return:
+            gtk_widget_grab_focus(GTK_WIDGET(chan_tree));
+        return TRUE;
+
+        case GDK_KEY_Escape:
+            gtk_entry_set_text(GTK_ENTRY(search_entry), "");
+            gtk_widget_grab_focus(GTK_WIDGET(cat_tree));
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+// typing over the lists starts a search
+gboolean search_start(GdkEventKey *event)
+{
+    if (gtk_search_entry_handle_event(search_entry, (GdkEvent*)event) != GDK_EVENT_STOP)
+        return FALSE;
+
+    gtk_entry_grab_focus_without_selecting(GTK_ENTRY(search_entry));
+    return TRUE;
+}
+
+// =====================================
+// PLAYER PROFILES
+// =====================================
+
+// caching and decoding options applied to each stream opened
+typedef struct player_profile {
+    const char* name;
+    int network_caching;    // ms
+    int live_caching;       // ms
+} player_profile_t;
+
+static const player_profile_t player_profiles[] = {
+    { "low-latency", 300,  300  },
+    { "balanced",    1000, 1000 },
+    { "robust",      5000, 3000 },
+};
+
+#define PLAYER_NUM_PROFILES (sizeof(player_profiles) / sizeof(player_profiles[0]))
+
+char* player_profile_name;      // --profile
+char** player_group_profiles;   // --group-profile, "Group=profile"
+char* player_hw_decode = "any"; // --hw-decode, value of :avcodec-hw
+
+static const player_profile_t* player_default_profile = &player_profiles[1];
+static GHashTable* player_profile_by_group; // group name -> profile
+
+const player_profile_t* player_profile_find(const char* name)
+{
+    for (size_t p = 0; p < PLAYER_NUM_PROFILES; p++)
+        if (strcmp(player_profiles[p].name, name) == 0)
+            return &player_profiles[p];
+
+    fprintf(stderr, "\nUnknown profile '%s' - use low-latency, balanced or robust\n", name);
+    return NULL;
+}
+
+// validates the profile options - returns 0 on error
+int player_profiles_init()
+{
+    if (player_profile_name != NULL)
+        if ((player_default_profile = player_profile_find(player_profile_name)) == NULL)
+            return 0;
+
+    player_profile_by_group = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (char** spec = player_group_profiles; spec != NULL && *spec != NULL; spec++)
+    {
+        char* sep = strrchr(*spec, '=');
+        if (sep == NULL || sep == *spec)
+        {
+            fprintf(stderr, "\nInvalid group profile '%s' - expected Group=profile\n", *spec);
+            return 0;
+        }
+
+        *sep = '\0'; // the option strings are kept for the lifetime of the program
+
+        const player_profile_t* profile = player_profile_find(sep + 1);
+        if (profile == NULL)
+            return 0;
+
+        g_hash_table_insert(player_profile_by_group, *spec, (gpointer)profile);
+    }
+
+    return 1;
+}
+
+const player_profile_t* player_profile_for(int group)
+{
+    const player_profile_t* profile = NULL;
+
+    if (group >= 0 && player_profile_by_group != NULL)
+        profile = (const player_profile_t*)g_hash_table_lookup(player_profile_by_group, playlist.groups[group].group_name);
+
+    return (profile == NULL) ? player_default_profile : profile;
+}
+
+void player_profile_apply(libvlc_media_t* media, const player_profile_t* profile)
+{
+    char option[64];
+
+    snprintf(option, sizeof(option), ":network-caching=%d", profile->network_caching);
+    libvlc_media_add_option(media, option);
+
+    snprintf(option, sizeof(option), ":live-caching=%d", profile->live_caching);
+    libvlc_media_add_option(media, option);
+
+    snprintf(option, sizeof(option), ":avcodec-hw=%s", player_hw_decode);
+    libvlc_media_add_option(media, option);
+}
+
+// =====================================
+// PLAYER WORKER
+// =====================================
+
+// libvlc calls may block for a long time (stopping a dead stream), so they run in a thread of their own
+typedef enum player_cmd_type {
+    PLAYER_CMD_PLAY,
+    PLAYER_CMD_STOP,
+    PLAYER_CMD_MUTE,
+    PLAYER_CMD_UNMUTE,
+    PLAYER_CMD_QUIT,
+} player_cmd_type_t;
+
+typedef struct player_cmd {
+    player_cmd_type_t type;
+    libvlc_media_player_t* player;
+    char* url;          // PLAYER_CMD_PLAY only
+    uint32_t xid;       // window to draw on
+    const player_profile_t* profile;
+    uint32_t generation;    // PLAYER_CMD_PLAY and PLAYER_CMD_STOP
+} player_cmd_t;
+
+static GMutex player_lock;
+static GCond player_cond;
+static GQueue player_queue = G_QUEUE_INIT;
+static GThread* player_thread;
+
+// each play or stop request starts a generation of the player, and its events are tagged with the one
+// the worker started last: those of a stream already replaced (e.g. a late error) can be told apart
+#define PLAYER_MAX_WATCHED 8
+
+typedef struct player_generation {
+    libvlc_media_player_t* player;
+    uint32_t requested; // by the GTK thread
+    uint32_t started;   // by the worker, read by the libvlc threads
+} player_generation_t;
+
+static player_generation_t player_generations[PLAYER_MAX_WATCHED]; // filled before the worker starts
+static int player_num_generations;
+
+player_generation_t* player_generation_of(libvlc_media_player_t* player)
+{
+    for (int p = 0; p < player_num_generations; p++)
+        if (player_generations[p].player == player)
+            return &player_generations[p];
+
+    return NULL;
+}
+
+// in the worker, once the previous media is stopped
+void player_generation_start(const player_cmd_t* cmd)
+{
+    player_generation_t* generation = player_generation_of(cmd->player);
+
+    if (generation != NULL)
+        __atomic_store_n(&generation->started, cmd->generation, __ATOMIC_RELEASE);
+}
+
+// a newer command supersedes the queued ones of the same kind for the same player:
+// only the last channel requested by quick key presses is really opened
+int player_cmd_supersedes(const player_cmd_t* newer, const player_cmd_t* older)
+{
+    if (newer->type == PLAYER_CMD_QUIT || newer->player != older->player)
+        return 0;
+
+    int newer_media = (newer->type == PLAYER_CMD_PLAY || newer->type == PLAYER_CMD_STOP);
+    int older_media = (older->type == PLAYER_CMD_PLAY || older->type == PLAYER_CMD_STOP);
+
+    return newer_media == older_media;
+}
+
+void player_cmd_free(player_cmd_t* cmd)
+{
+    free(cmd->url);
+    free(cmd);
+}
+
+void player_send(player_cmd_type_t type, libvlc_media_player_t* player, const char* url, uint32_t xid, const player_profile_t* profile)
+{
+    player_cmd_t* cmd = (player_cmd_t*)malloc(sizeof(player_cmd_t));
+    if (cmd == NULL)
+        return;
+
+    *cmd = (player_cmd_t) {
+        .type = type,
+        .player = player,
+        .url = (url == NULL) ? NULL : strdup(url),
+        .xid = xid,
+        .profile = profile,
+    };
+
+    player_generation_t* generation = player_generation_of(player);
+
+    if (generation != NULL && (type == PLAYER_CMD_PLAY || type == PLAYER_CMD_STOP))
+        cmd->generation = ++generation->requested;
+
+    g_mutex_lock(&player_lock);
+
+    for (GList* node = player_queue.head; node != NULL; )
+    {
+        GList* next = node->next;
+
+        if (player_cmd_supersedes(cmd, (player_cmd_t*)node->data))
+        {
+            player_cmd_free((player_cmd_t*)node->data);
+            g_queue_delete_link(&player_queue, node);
+        }
+
+        node = next;
+    }
+
+    g_queue_push_tail(&player_queue, cmd);
+    g_cond_signal(&player_cond);
+    g_mutex_unlock(&player_lock);
+}
+
+gpointer player_worker(gpointer data)
+{
+    for (;;)
+    {
+        player_cmd_t* cmd;
+
+        g_mutex_lock(&player_lock);
+        while ((cmd = (player_cmd_t*)g_queue_pop_head(&player_queue)) == NULL)
+            g_cond_wait(&player_cond, &player_lock);
+        g_mutex_unlock(&player_lock);
+
+        switch (cmd->type)
+        {
+            case PLAYER_CMD_PLAY:
+            {
+                libvlc_media_player_stop(cmd->player);
+                player_generation_start(cmd);
+                libvlc_media_player_set_xwindow(cmd->player, cmd->xid);
+
+                libvlc_media_t *media = libvlc_media_new_location(vlc_inst, cmd->url);
+                player_profile_apply(media, cmd->profile);
+                libvlc_media_player_set_media(cmd->player, media);
+
+                libvlc_media_player_play(cmd->player);
+                libvlc_media_release(media);
+            }
+            break;
+
+            case PLAYER_CMD_STOP:
+                libvlc_media_player_stop(cmd->player);
+                player_generation_start(cmd);
+                libvlc_media_player_set_media(cmd->player, NULL);
+                libvlc_media_player_set_xwindow(cmd->player, 0);
+            break;
+
+            case PLAYER_CMD_MUTE:
+            case PLAYER_CMD_UNMUTE:
+                libvlc_audio_set_mute(cmd->player, cmd->type == PLAYER_CMD_MUTE);
+            break;
+
+            case PLAYER_CMD_QUIT:
+                player_cmd_free(cmd);
+                return NULL;
+        }
+
+        player_cmd_free(cmd);
+    }
+}
+
+typedef struct player_event {
+    libvlc_media_player_t* player;
+    int type;
+    int64_t time;
+    float cache;    // buffering: percent of the cache filled
+    uint32_t generation;
+} player_event_t;
+
+gboolean player_event_idle(gpointer data);
+
+// called from a libvlc thread: hand it over to the GTK thread
+void player_event_cb(const struct libvlc_event_t* event, void* data)
+{
+    player_event_t* ev = (player_event_t*)malloc(sizeof(player_event_t));
+    if (ev == NULL)
+        return;
+
+    player_generation_t* generation = (player_generation_t*)data;
+
+    ev->player = generation->player;
+    ev->generation = __atomic_load_n(&generation->started, __ATOMIC_ACQUIRE);
+    ev->type = event->type;
+    ev->time = trace_now();
+    ev->cache = (event->type == libvlc_MediaPlayerBuffering) ? event->u.media_player_buffering.new_cache : 0;
+
+    g_idle_add(player_event_idle, ev);
+}
+
+void player_watch(libvlc_media_player_t* player)
+{
+    static const libvlc_event_e events[] = {
+        libvlc_MediaPlayerPlaying,
+        libvlc_MediaPlayerBuffering,
+        libvlc_MediaPlayerVout,
+        libvlc_MediaPlayerStopped,
+        libvlc_MediaPlayerEndReached,
+        libvlc_MediaPlayerEncounteredError,
+    };
+
+    if (player_num_generations == PLAYER_MAX_WATCHED)
+        return;
+
+    player_generation_t* generation = &player_generations[player_num_generations++];
+    *generation = (player_generation_t) { .player = player };
+
+    libvlc_event_manager_t* manager = libvlc_media_player_event_manager(player);
+
+    for (size_t e = 0; e < sizeof(events) / sizeof(events[0]); e++)
+        libvlc_event_attach(manager, events[e], player_event_cb, generation);
+}
+
+// the event comes from the stream last requested for the player
+int player_event_current(const player_event_t* ev)
+{
+    const player_generation_t* generation = player_generation_of(ev->player);
+
+    return generation != NULL && ev->generation == generation->requested;
+}
+
+void player_worker_start()
+{
+    player_thread = g_thread_new("player", player_worker, NULL);
+}
+
+// runs the commands still queued (e.g. stops) and waits for the thread to finish
+void player_worker_stop()
+{
+    player_send(PLAYER_CMD_QUIT, NULL, NULL, 0, NULL);
+    g_thread_join(player_thread);
+    player_thread = NULL;
+}
+
+// the window is resolved here, in the GTK thread - the stream is opened by the worker
+uint32_t player_window(GtkWidget* wid)
+{
+    if (!gtk_widget_is_visible(wid))
+        gtk_widget_show(wid);
+
+    gtk_widget_realize(wid); // make sure it has a window, even if hidden
+    return GDK_WINDOW_XID(gtk_widget_get_window(wid));
+}
+
+// =====================================
+// PLAYBACK QUALITY
+// =====================================
+
+// per channel metrics, to find overloaded channels and tune the caching profiles: time to first
+// frame and stalls come from the libvlc events, bitrates and lost frames from the media statistics,
+// sampled every QOS_SAMPLE_SECONDS - printed every --qos-log seconds and answered by the
+// 'metrics' command of the control socket in the Prometheus text format
+int qos_log_seconds = 0; // --qos-log
+
+#define QOS_SAMPLE_SECONDS  5
+#define QOS_MAX_PLAYERS     8   // zap pool
+
+typedef struct qos_channel {
+    gint64 key;                 // group << 32 | entry
+    int group;
+    int entry;
+    uint64_t plays;
+    uint64_t errors;
+    uint64_t stalls;            // buffering after the playback started
+    uint64_t first_frames;
+    double first_frame_sum;     // seconds
+    double first_frame_last;
+    double input_kbps;          // last sample, 0 when stopped
+    double demux_kbps;
+    uint64_t displayed_frames;  // totals of every play
+    uint64_t lost_frames;
+    uint64_t lost_audio;
+    uint64_t demux_corrupted;
+} qos_channel_t;
+
+// channel loaded in each player - the statistics of libvlc restart with every media
+typedef struct qos_player {
+    libvlc_media_player_t* player;
+    qos_channel_t* channel;     // NULL if stopped
+    int64_t opened;             // 0 after the first frame
+    uint8_t playing;
+    uint8_t stalled;
+    libvlc_media_stats_t last;  // previous sample of the current media
+} qos_player_t;
+
+static GHashTable* qos_channels;
+static qos_player_t qos_players[QOS_MAX_PLAYERS];
+static int qos_num_players;
+
+qos_channel_t* qos_channel(int group, int entry)
+{
+    gint64 key = ((gint64)group << 32) | (uint32_t)entry;
+    qos_channel_t* channel = (qos_channel_t*)g_hash_table_lookup(qos_channels, &key);
+
+    if (channel == NULL)
+    {
+        channel = g_new0(qos_channel_t, 1);
+        channel->key = key;
+        channel->group = group;
+        channel->entry = entry;
+        g_hash_table_insert(qos_channels, &channel->key, channel);
+    }
+
+    return channel;
+}
+
+qos_player_t* qos_player(libvlc_media_player_t* player, int add)
+{
+    for (int p = 0; p < qos_num_players; p++)
+        if (qos_players[p].player == player)
+            return &qos_players[p];
+
+    if (!add || qos_num_players == QOS_MAX_PLAYERS)
+        return NULL;
+
+    qos_player_t* record = &qos_players[qos_num_players++];
+    memset(record, 0, sizeof(*record));
+    record->player = player;
+
+    return record;
+}
+
+// adds what the media counted since the previous sample
+void qos_sample(qos_player_t* record)
+{
+    // before 'playing' the player may still have the media of the previous channel
+    if (record->channel == NULL || !record->playing)
+        return;
+
+    libvlc_media_t* media = libvlc_media_player_get_media(record->player);
+    if (media == NULL)
+        return;
+
+    libvlc_media_stats_t stats;
+
+    if (libvlc_media_get_stats(media, &stats))
+    {
+        qos_channel_t* channel = record->channel;
+        libvlc_media_stats_t* last = &record->last;
+
+        // bytes per microsecond
+        channel->input_kbps = stats.f_input_bitrate * 8000;
+        channel->demux_kbps = stats.f_demux_bitrate * 8000;
+
+        channel->displayed_frames += MAX(stats.i_displayed_pictures - last->i_displayed_pictures, 0);
+        channel->lost_frames += MAX(stats.i_lost_pictures - last->i_lost_pictures, 0);
+        channel->lost_audio += MAX(stats.i_lost_abuffers - last->i_lost_abuffers, 0);
+        channel->demux_corrupted += MAX(stats.i_demux_corrupted - last->i_demux_corrupted, 0);
+
+        *last = stats;
+    }
+
+    libvlc_media_release(media);
+}
+
+// the player is about to stop, keep what was counted so far
+void qos_closed(libvlc_media_player_t* player)
+{
+    qos_player_t* record = qos_player(player, 0);
+
+    if (record == NULL || record->channel == NULL)
+        return;
+
+    qos_sample(record);
+    record->channel->input_kbps = record->channel->demux_kbps = 0;
+    record->channel = NULL;
+    record->playing = 0;
+}
+
+// the player is about to open the channel
+void qos_opened(libvlc_media_player_t* player, int group, int entry)
+{
+    qos_player_t* record = qos_player(player, 1);
+    if (record == NULL)
+        return;
+
+    qos_closed(player);
+
+    record->channel = qos_channel(group, entry);
+    record->channel->plays++;
+    record->opened = trace_now();
+    record->stalled = 0;
+    memset(&record->last, 0, sizeof(record->last));
+}
+
+void qos_event(const player_event_t* ev)
+{
+    qos_player_t* record = qos_player(ev->player, 0);
+
+    if (record == NULL || record->channel == NULL)
+        return;
+
+    qos_channel_t* channel = record->channel;
+
+    switch (ev->type)
+    {
+        case libvlc_MediaPlayerPlaying:
+            record->playing = 1;
+            record->stalled = 0;
+        break;
+
+        case libvlc_MediaPlayerVout:
+            if (record->opened != 0)
+            {
+                channel->first_frame_last = (ev->time - record->opened) / 1e6;
+                channel->first_frame_sum += channel->first_frame_last;
+                channel->first_frames++;
+            }
+
+            record->opened = 0;
+        break;
+
+        case libvlc_MediaPlayerBuffering:
+            // reported while filling the cache before playing, too
+            if (ev->cache >= 100)
+                record->stalled = 0;
+            else if (record->playing && !record->stalled)
+            {
+                record->stalled = 1;
+                channel->stalls++;
+            }
+        break;
+
+        case libvlc_MediaPlayerEncounteredError:
+            channel->errors++;
+            record->playing = 0;
+        break;
+
+        default: // stopped or ended - also sent for the previous media when the player is reused
+            record->playing = 0;
+            channel->input_kbps = channel->demux_kbps = 0;
+        break;
+    }
+}
+
+gboolean qos_tick(gpointer data)
+{
+    static int elapsed;
+
+    for (int p = 0; p < qos_num_players; p++)
+        qos_sample(&qos_players[p]);
+
+    elapsed += QOS_SAMPLE_SECONDS;
+    if (qos_log_seconds <= 0 || elapsed < qos_log_seconds)
+        return G_SOURCE_CONTINUE;
+
+    elapsed = 0;
+
+    for (int p = 0; p < qos_num_players; p++)
+    {
+        qos_channel_t* channel = qos_players[p].channel;
+
+        if (channel == NULL || !qos_players[p].playing)
+            continue;
+
+        printf("\nQoS '%s': first frame %.2f s, %" PRIu64 " stalls, input %.0f kb/s, demux %.0f kb/s, %" PRIu64 " lost frames, %" PRIu64 " lost audio buffers\n",
+               playlist.groups[channel->group].entries[channel->entry].name, channel->first_frame_last, channel->stalls,
+               channel->input_kbps, channel->demux_kbps, channel->lost_frames, channel->lost_audio);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+void qos_init()
+{
+    qos_channels = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+    g_timeout_add_seconds(QOS_SAMPLE_SECONDS, qos_tick, NULL);
+}
+
+void qos_label(GString* out, const char* value)
+{
+    for (; *value != '\0'; value++)
+        switch (*value)
+        {
+            case '\\': g_string_append(out, "\\\\"); break;
+            case '"':  g_string_append(out, "\\\""); break;
+            case '\n': g_string_append(out, "\\n"); break;
+            default:   g_string_append_c(out, *value); break;
+        }
+}
+
+typedef struct qos_metric {
+    const char* name;
+    const char* type;
+    const char* help;
+    size_t offset;
+    uint8_t real;   // double, otherwise uint64_t
+} qos_metric_t;
+
+static const qos_metric_t qos_metrics[] = {
+    { "m3u_channel_plays_total",                "counter", "Times the channel was opened", offsetof(qos_channel_t, plays), 0 },
+    { "m3u_channel_errors_total",               "counter", "Times the channel failed to play", offsetof(qos_channel_t, errors), 0 },
+    { "m3u_channel_stalls_total",               "counter", "Times the playback stopped to buffer", offsetof(qos_channel_t, stalls), 0 },
+    { "m3u_channel_first_frame_seconds_sum",    "summary", "Time from opening the channel to its first frame", offsetof(qos_channel_t, first_frame_sum), 1 },
+    { "m3u_channel_first_frame_seconds_count",  NULL,      NULL, offsetof(qos_channel_t, first_frames), 0 },
+    { "m3u_channel_input_kbps",                 "gauge",   "Bitrate read from the stream", offsetof(qos_channel_t, input_kbps), 1 },
+    { "m3u_channel_demux_kbps",                 "gauge",   "Bitrate of the demuxed stream", offsetof(qos_channel_t, demux_kbps), 1 },
+    { "m3u_channel_displayed_frames_total",     "counter", "Video frames displayed", offsetof(qos_channel_t, displayed_frames), 0 },
+    { "m3u_channel_lost_frames_total",          "counter", "Video frames dropped", offsetof(qos_channel_t, lost_frames), 0 },
+    { "m3u_channel_lost_audio_buffers_total",   "counter", "Audio buffers dropped", offsetof(qos_channel_t, lost_audio), 0 },
+    { "m3u_channel_demux_corrupted_total",      "counter", "Corrupted packets found by the demuxer", offsetof(qos_channel_t, demux_corrupted), 0 },
+};
+
+// every channel played since the start, in the Prometheus text format
+void qos_export(GString* out)
+{
+    for (size_t m = 0; m < G_N_ELEMENTS(qos_metrics); m++)
+    {
+        const qos_metric_t* metric = &qos_metrics[m];
+
+        // the lines of a summary share its name and description, but not their suffix
+        if (metric->type != NULL)
+        {
+            size_t family = strlen(metric->name) - (strcmp(metric->type, "summary") == 0 ? strlen("_sum") : 0);
+            g_string_append_printf(out, "# HELP %.*s %s\n# TYPE %.*s %s\n", (int)family, metric->name, metric->help,
+                                   (int)family, metric->name, metric->type);
+        }
+
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, qos_channels);
+
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            const qos_channel_t* channel = (const qos_channel_t*)value;
+            const char* field = (const char*)channel + metric->offset;
+
+            g_string_append_printf(out, "%s{group=\"", metric->name);
+            qos_label(out, playlist.groups[channel->group].group_name);
+            g_string_append(out, "\",channel=\"");
+            qos_label(out, playlist.groups[channel->group].entries[channel->entry].name);
+
+            if (metric->real)
+                g_string_append_printf(out, "\"} %g\n", *(const double*)field);
+            else
+                g_string_append_printf(out, "\"} %" PRIu64 "\n", *(const uint64_t*)field);
+        }
+    }
+}
+
+// =====================================
+// FAILOVER
+// =====================================
+
+// a channel is played from the candidate which started fastest so far (see CHANNEL CANDIDATES), and the
+// next one is tried on an error or if there is no picture after 'failover_timeout' seconds
+int failover_timeout = 6; // --failover-timeout, 0 only switches on errors
+
+typedef struct failover_player {
+    libvlc_media_player_t* player;
+    uint32_t xid;
+    int group;          // channel requested
+    playlist_ref_t candidates[CANDIDATES_MAX];
+    int num_candidates;
+    int current;        // candidate being played - -1 if none
+    int64_t tried;      // when it was started, 0 after its first frame
+    guint deadline;     // timeout source - 0 if none
+} failover_player_t;
+
+static failover_player_t failover_players[QOS_MAX_PLAYERS];
+static int failover_num_players;
+
+gboolean failover_deadline(gpointer data);
+
+failover_player_t* failover_player(libvlc_media_player_t* player, int add)
+{
+    for (int p = 0; p < failover_num_players; p++)
+        if (failover_players[p].player == player)
+            return &failover_players[p];
+
+    if (!add || failover_num_players == QOS_MAX_PLAYERS)
+        return NULL;
+
+    failover_player_t* record = &failover_players[failover_num_players++];
+    memset(record, 0, sizeof(*record));
+    record->player = player;
+    record->current = -1;
+
+    return record;
+}
+
+void failover_cancel(failover_player_t* record)
+{
+    if (record->deadline != 0)
+        g_source_remove(record->deadline);
+
+    record->deadline = 0;
+}
+
+void failover_try(failover_player_t* record)
+{
+    const playlist_entry_t* entry = candidate_entry(record->candidates[record->current]);
+
+    if (record->current > 0)
+        printf("\nTrying candidate %d of %d: '%s'\n", record->current + 1, record->num_candidates, entry->url);
+
+    record->tried = trace_now();
+
+    if (failover_timeout > 0)
+        record->deadline = g_timeout_add_seconds(failover_timeout, failover_deadline, record);
+
+    player_send(PLAYER_CMD_PLAY, record->player, entry->url, record->xid, player_profile_for(record->group));
+}
+
+// the current candidate failed - returns 1 if there is another one
+int failover_next(failover_player_t* record)
+{
+    failover_cancel(record);
+    candidate_record(candidate_entry(record->candidates[record->current])->url, -1);
+
+    if (record->current + 1 >= record->num_candidates)
+    {
+        record->current = -1;
+        return 0;
+    }
+
+    record->current++;
+    failover_try(record);
+    return 1;
+}
+
+gboolean failover_deadline(gpointer data)
+{
+    failover_player_t* record = (failover_player_t*)data;
+    record->deadline = 0;
+
+    // radios have no picture: decoded audio means it started
+    libvlc_media_t* media = libvlc_media_player_get_media(record->player);
+    libvlc_media_stats_t stats;
+    int audio = (media != NULL && libvlc_media_get_stats(media, &stats) && stats.i_decoded_audio > 0);
+
+    if (media != NULL)
+        libvlc_media_release(media);
+
+    if (audio)
+        record->tried = 0;
+    else
+    {
+        fprintf(stderr, "\nNo picture from '%s' after %d s\n", candidate_entry(record->candidates[record->current])->name, failover_timeout);
+        failover_next(record);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+// opens the channel in the player (xid 0 for a window of its own)
+void failover_play(libvlc_media_player_t* player, uint32_t xid, int group, int entry)
+{
+    failover_player_t* record = failover_player(player, 1);
+
+    if (record == NULL)
+    {
+        player_send(PLAYER_CMD_PLAY, player, playlist.groups[group].entries[entry].url, xid, player_profile_for(group));
+        return;
+    }
+
+    failover_cancel(record);
+    record->xid = xid;
+    record->group = group;
+    record->num_candidates = candidates_of(group, entry, record->candidates, MAX(failover_timeout, 1) * 1000.0);
+    record->current = 0;
+    failover_try(record);
+}
+
+void failover_stop(libvlc_media_player_t* player)
+{
+    failover_player_t* record = failover_player(player, 0);
+
+    if (record == NULL)
+        return;
+
+    failover_cancel(record);
+    record->current = -1;
+}
+
+// returns 1 if the event was an error and another candidate is being tried
+int failover_event(const player_event_t* ev)
+{
+    failover_player_t* record = failover_player(ev->player, 0);
+
+    if (record == NULL || record->current < 0)
+        return 0;
+
+    switch (ev->type)
+    {
+        case libvlc_MediaPlayerVout:
+            if (record->tried != 0)
+                candidate_record(candidate_entry(record->candidates[record->current])->url, ev->time - record->tried);
+
+            record->tried = 0;
+            failover_cancel(record);
+        break;
+
+        case libvlc_MediaPlayerEncounteredError:
+            return failover_next(record);
+    }
+
+    return 0;
+}
+
+// =====================================
+// ZAPPING
+// =====================================
+
+// besides the channel being watched, the pool keeps its neighbours in the group playing muted
+// in hidden pages of the 'player_area' stack, so switching to them only needs to show their page
+int zap_pool_size = 3; // --zap-pool
+
+typedef struct zap_slot {
+    libvlc_media_player_t* player;
+    GtkWidget* area;    // video output - a page of 'player_area'
+    int group;          // channel loaded in the player - -1 if none
+    int entry;
+    uint8_t playing;    // reported by libvlc events
+    int64_t opened;     // when the channel was requested, until its first frame (trace only)
+    const char* trace_name;
+} zap_slot_t;
+
+static zap_slot_t* zap_slots;
+static int zap_num_slots;
+static int zap_current; // slot being watched - its player is 'media_player'
+
+void zap_init()
+{
+    zap_num_slots = (zap_pool_size < 1) ? 1 : (zap_pool_size > 8) ? 8 : zap_pool_size;
+    zap_slots = (zap_slot_t*)calloc(zap_num_slots, sizeof(zap_slot_t));
+
+    for (int s = 0; s < zap_num_slots; s++)
+    {
+        zap_slot_t* slot = &zap_slots[s];
+
+        slot->player = (s == 0) ? media_player : libvlc_media_player_new(vlc_inst);
+        slot->group = slot->entry = -1;
+        slot->playing = 0;
+        player_watch(slot->player);
+
+        slot->area = gtk_drawing_area_new();
+        gtk_widget_set_hexpand(slot->area, TRUE);
+        gtk_widget_set_vexpand(slot->area, TRUE);
+        gtk_widget_show(slot->area);
+        gtk_container_add(GTK_CONTAINER(channel_player), slot->area);
+    }
+
+    zap_current = 0;
+    player_worker_start();
+}
+
+zap_slot_t* zap_find(int group, int entry)
+{
+    for (int s = 0; s < zap_num_slots; s++)
+        if (zap_slots[s].group == group && zap_slots[s].entry == entry)
+            return &zap_slots[s];
+
+    return NULL;
+}
+
+void zap_stop(zap_slot_t* slot)
+{
+    if (slot->group < 0)
+        return;
+
+    qos_closed(slot->player);
+    failover_stop(slot->player);
+    player_send(PLAYER_CMD_STOP, slot->player, NULL, 0, NULL);
+    slot->group = slot->entry = -1;
+    slot->playing = 0;
+}
+
+void zap_stop_all()
+{
+    for (int s = 0; s < zap_num_slots; s++)
+        zap_stop(&zap_slots[s]);
+}
+
+// releases every player, 'media_player' included
+void zap_release()
+{
+    if (zap_slots == NULL) // libVLC was not ready yet
+    {
+        if (media_player != NULL)
+            libvlc_media_player_release(media_player);
+
+        media_player = NULL;
+        return;
+    }
+
+    zap_stop_all();
+    player_worker_stop();
+
+    for (int s = 0; s < zap_num_slots; s++)
+        libvlc_media_player_release(zap_slots[s].player);
+
+    free(zap_slots);
+    media_player = NULL;
+}
+
+// starts the channel in the slot's own page of the stack
+void zap_load(zap_slot_t* slot, int group, int entry, int muted)
+{
+    slot->group = group;
+    slot->entry = entry;
+    slot->playing = 0; // until its own events arrive
+
+    slot->opened = trace_enabled ? trace_now() : 0;
+    slot->trace_name = muted ? "first_frame_warm" : "first_frame";
+    qos_opened(slot->player, group, entry);
+    failover_play(slot->player, player_window(slot->area), group, entry);
+    player_send(muted ? PLAYER_CMD_MUTE : PLAYER_CMD_UNMUTE, slot->player, NULL, 0, NULL);
+}
+
+// makes the slot the one being watched
+void zap_show(int s)
+{
+    if (s != zap_current)
+        player_send(PLAYER_CMD_MUTE, zap_slots[zap_current].player, NULL, 0, NULL); // keeps buffering as a neighbour
+
+    zap_current = s;
+    media_player = zap_slots[s].player;
+
+    gtk_widget_show(channel_player);
+    gtk_stack_set_visible_child(GTK_STACK(channel_player), zap_slots[s].area);
+    player_send(PLAYER_CMD_UNMUTE, media_player, NULL, 0, NULL);
+}
+
+// plays the channel, switching to a warm player if one has it
+void zap_to(int group, int entry)
+{
+    zap_slot_t* warm = zap_find(group, entry);
+
+    if (warm != NULL)
+        zap_show(warm - zap_slots); // already buffered
+    else
+    {
+        zap_show(zap_current);
+        zap_load(&zap_slots[zap_current], group, entry, 0);
+    }
+}
+
+// loads the channels around the one being watched into the other slots (muted)
+void zap_warm_neighbours()
+{
+    zap_slot_t* current = &zap_slots[zap_current];
+
+    if (zap_num_slots < 2 || current->group < 0)
+        return;
+
+    // neighbours as listed, which may be sorted, filtered by health or search results
+    int current_row = chan_model_row_of(chan_model, current->group, current->entry);
+    int num_rows = chan_model->num_rows;
+
+    if (current_row < 0)
+        return;
+
+    playlist_ref_t wanted[zap_num_slots];
+    int num_wanted = 0;
+    uint8_t keep[zap_num_slots];
+
+    memset(keep, 0, sizeof(keep));
+    keep[zap_current] = 1;
+
+    // next, previous, second next, second previous...
+    for (int distance = 1; num_wanted < zap_num_slots - 1 && distance < num_rows; distance++)
+        for (int sign = 1; sign >= -1 && num_wanted < zap_num_slots - 1; sign -= 2)
+        {
+            int row = current_row + sign * distance;
+
+            if (row < 0 || row >= num_rows)
+                continue;
+
+            playlist_ref_t ref = chan_model_ref(chan_model, row);
+
+            zap_slot_t* slot = zap_find(ref.group, ref.entry);
+            if (slot != NULL)
+                keep[slot - zap_slots] = 1; // already warm
+            else
+                wanted[num_wanted++] = ref;
+        }
+
+    for (int w = 0, s = 0; w < num_wanted; w++)
+    {
+        while (s < zap_num_slots && keep[s])
+            s++;
+
+        if (s == zap_num_slots)
+            break;
+
+        zap_load(&zap_slots[s], wanted[w].group, wanted[w].entry, 1);
+        keep[s] = 1;
+    }
+
+    // slots with channels far from the current do not need to use bandwidth
+    for (int s = 0; s < zap_num_slots; s++)
+        if (!keep[s])
+            zap_stop(&zap_slots[s]);
+}
+
+// state changes of the players, reported by libvlc
+gboolean player_event_idle(gpointer data)
+{
+    player_event_t* ev = (player_event_t*)data;
+
+    if (!player_event_current(ev)) // from a stream replaced or stopped since
+    {
+        free(ev);
+        return G_SOURCE_REMOVE;
+    }
+
+    qos_event(ev);
+    int retrying = failover_event(ev);
+
+    for (int s = 0; s < zap_num_slots; s++)
+    {
+        zap_slot_t* slot = &zap_slots[s];
+
+        if (slot->player != ev->player || slot->group < 0)
+            continue;
+
+        const char* name = playlist.groups[slot->group].entries[slot->entry].name;
+
+        switch (ev->type)
+        {
+            case libvlc_MediaPlayerPlaying:
+                slot->playing = 1;
+                if (s == zap_current)
+                    printf("\nPlaying '%s'\n", name);
+            break;
+
+            case libvlc_MediaPlayerBuffering:
+            break;
+
+            case libvlc_MediaPlayerVout: // video output created: first frame decoded
+                if (slot->opened != 0)
+                    trace_complete(slot->trace_name, slot->opened, ev->time);
+
+                slot->opened = 0;
+            break;
+
+            case libvlc_MediaPlayerEncounteredError:
+                if (retrying) // with another candidate
+                    break;
+
+                // forget it, so it is opened again next time it is requested
+                fprintf(stderr, "\nFailed to play '%s'\n", name);
+                slot->group = slot->entry = -1;
+                slot->playing = 0;
+            break;
+
+            default: // stopped or ended
+                slot->playing = 0;
+            break;
+        }
+    }
+
+    free(ev);
+    return G_SOURCE_REMOVE;
+}
+
+void player_do(uint8_t bOpen)
+{
+    if (zap_slots == NULL) // libVLC is still starting
+        return;
+
+    if (bOpen)
+    {
+        // the window is up before the playlist is loaded
+        if (selected_group < 0 || (uint32_t)selected_group >= playlist.num_groups ||
+            selected_channel < 0 || (uint32_t)selected_channel >= playlist.groups[selected_group].num_entries)
+            return;
+
+        static char* last_url;
+        char* url = playlist.groups[selected_group].entries[selected_channel].url;
+
+        printf("\nPlay URL = '%s'\n", url);
+        logo_prefetch_pause(1);
+
+        if (zap_slots[zap_current].playing && last_url == url) // repeate play command
+        {
+            gtk_widget_hide(channel_player);
+            zap_slots[zap_current].opened = trace_enabled ? trace_now() : 0;
+            zap_slots[zap_current].trace_name = "first_frame";
+            qos_opened(media_player, selected_group, selected_channel);
+            failover_play(media_player, player_window(GTK_WIDGET(main_window)), selected_group, selected_channel);
+        }
+        else
+        {
+            last_url = url;
+            history_add(HISTORY_RECENT, selected_group, selected_channel, 0);
+            zap_to(selected_group, selected_channel);
+            zap_warm_neighbours();
+        }
+    }
+    else
+    {
+        zap_stop_all();
+        gtk_widget_hide(GTK_WIDGET(channel_player));
+        logo_prefetch_pause(0);
+    }
+}
+
+gboolean chan_tree_key(GtkWidget* widget, GdkEventKey *event, gpointer data)
+{
+    switch (event->keyval)
+    {
+        case GDK_KEY_Left:
+            gtk_widget_grab_focus(GTK_WIDGET(cat_tree));
+        break;
+
+        case GDK_KEY_Return:
+            player_do(1);
+        break;
+
+        case GDK_KEY_F2: // playlist order, sorted by health, dead channels hidden
+            chan_order = (chan_order + 1) % CHAN_NUM_ORDERS;
+            chan_model_reorder(chan_model, chan_tree);
+        break;
+
+        case GDK_KEY_F3: // adds to or removes from the favourites
+            history_add(HISTORY_FAVOURITES, selected_group, selected_channel, 1);
+        break;
+
+        case GDK_KEY_Escape:
+        case GDK_KEY_Home:
+        case GDK_KEY_BackSpace:
+            player_do(0);
+        break;
+
+        default:
+            return search_start(event);
+    }
+
+    return FALSE;
+}
+
+gboolean cat_tree_key(GtkWidget* widget, GdkEventKey *event, gpointer data)
+{
+    switch (event->keyval)
+    {
+        case GDK_KEY_Right:
+        case GDK_KEY_Return:
+            gtk_widget_grab_focus(GTK_WIDGET(chan_tree));
+        break;
+
+        case GDK_KEY_Escape:
+        case GDK_KEY_Home:
+        case GDK_KEY_BackSpace:
+            player_do(0);
+        break;
+
+        default:
+            return search_start(event);
+    }
+
+    return FALSE;
+}
+
+// =====================================
+// PLAYLIST STREAMING
+// =====================================
+
+// downloads the playlist while the GUI is running, showing the groups as they are parsed
+typedef struct playlist_stream {
+    CURLM* multi;
+    CURL* curl;
+    char* url;
+    m3u_download_t download;
+} playlist_stream_t;
+
+static int playlist_streaming; // the first download (or read, see STARTUP) is not over
+
+gboolean playlist_stream_tick(gpointer data)
+{
+    playlist_stream_t* stream = (playlist_stream_t*)data;
+
+    int running = 0;
+    curl_multi_perform(stream->multi, &running);
+
+    // the write callback already parsed whatever arrived: show it
+    fill_groups_list();
+    update_channel_list();
+
+    if (running)
+        return G_SOURCE_CONTINUE;
+
+    int queued;
+    CURLMsg* msg = curl_multi_info_read(stream->multi, &queued);
+    CURLcode result = (msg && msg->msg == CURLMSG_DONE) ? msg->data.result : CURLE_RECV_ERROR;
+
+    // the last line may not have a line break, or the snapshot is loaded if the playlist did not change
+    printf("\nPlaylist loaded: %u entries\n", m3u_download_finish(&stream->download, stream->curl, stream->url, result));
+    fill_groups_list();
+    update_channel_list();
+    playlist_loaded();
+    playlist_streaming = 0;
+
+    curl_multi_remove_handle(stream->multi, stream->curl);
+    curl_easy_cleanup(stream->curl);
+    curl_multi_cleanup(stream->multi);
+    free(stream->url);
+    free(stream);
+
+    return G_SOURCE_REMOVE;
+}
+
+int playlist_stream_start(const char* url)
+{
+    playlist_stream_t* stream = (playlist_stream_t*)malloc(sizeof(playlist_stream_t));
+    if (stream == NULL)
+        return 0;
+
+    stream->multi = curl_multi_init();
+    stream->curl = curl_easy_init();
+
+    if (stream->multi == NULL || stream->curl == NULL)
+    {
+        fprintf(stderr, "\nCannot create curl handles to download '%s'\n", url);
+        curl_easy_cleanup(stream->curl);
+        curl_multi_cleanup(stream->multi);
+        free(stream);
+        return 0;
+    }
+
+    stream->url = strdup(url);
+
+    playlist_init(&playlist);
+    m3u_download_setup(&stream->download, stream->curl, url, &playlist);
+    curl_multi_add_handle(stream->multi, stream->curl);
+
+    // the transfer is driven from the GTK loop, so the playlist is only touched by this thread
+    g_timeout_add(50, playlist_stream_tick, stream);
+    playlist_streaming = 1;
+    return 1;
+}
+
+// =====================================
+// PLAYLIST SOURCES
+// =====================================
+
+// several playlists (providers, local lists) are read in parallel and merged into one catalogue
+typedef struct playlist_source_job {
+    const char* source;
+    playlist_t playlist;
+    uint32_t num_entries;
+    GThread* thread;
+} playlist_source_job_t;
+
+gpointer playlist_source_worker(gpointer data)
+{
+    playlist_source_job_t* job = (playlist_source_job_t*)data;
+
+    TRACE_BEGIN(start);
+    job->num_entries = read_playlist(job->source, &job->playlist);
+    TRACE_END("read_playlist", start);
+
+    return NULL;
+}
+
+// merges the sources in the order given - returns the number of entries of the catalogue
+uint32_t read_playlists(char** sources, int num_sources, playlist_t* playlist)
+{
+    if (num_sources == 1)
+    {
+        TRACE_BEGIN(start);
+        uint32_t num_entries = read_playlist(sources[0], playlist); // nothing to merge: keeps the snapshot mapped
+        TRACE_END("read_playlist", start);
+
+        return num_entries;
+    }
+
+    TRACE_BEGIN(start);
+
+    playlist_source_job_t* jobs = (playlist_source_job_t*)calloc(num_sources, sizeof(playlist_source_job_t));
+    if (jobs == NULL)
+        return 0;
+
+    for (int s = 0; s < num_sources; s++)
+    {
+        jobs[s].source = sources[s];
+        jobs[s].thread = g_thread_new("source", playlist_source_worker, &jobs[s]);
+    }
+
+    playlist_merge_t merge;
+    playlist_merge_init(&merge);
+    playlist_init(playlist);
+
+    uint32_t total_entries = 0;
+
+    for (int s = 0; s < num_sources; s++)
+    {
+        g_thread_join(jobs[s].thread);
+
+        if (jobs[s].num_entries == 0)
+            fprintf(stderr, "\nCannot read playlist %s\n", jobs[s].source);
+        else
+            total_entries += playlist_merge_add(&merge, playlist, &jobs[s].playlist, s);
+
+        playlist_destroy(&jobs[s].playlist);
+    }
+
+    if (merge.duplicates != 0 || merge.alternates != 0)
+        printf("\nMerged %d playlists: %u entries, %u duplicates dropped, %u kept as alternates\n", num_sources, total_entries,
+               merge.duplicates, merge.alternates);
+
+    playlist_merge_destroy(&merge);
+    free(jobs);
+
+    TRACE_END("read_playlists", start);
+    return total_entries;
+}
+
+// =====================================
+// PLAYLIST REFRESH
+// =====================================
+
+// providers rotate the tokens in the stream urls: the playlist is parsed again in background
+// every 'refresh_minutes' and the differences applied to the one in use
+int refresh_minutes = 0; // --refresh, 0 disables
+
+static char** refresh_sources;
+static int refresh_num_sources;
+static int refresh_running;
+
+gboolean refresh_apply(gpointer data)
+{
+    playlist_t* fresh = (playlist_t*)data;
+    playlist_update_stats_t stats;
+
+    refresh_running = 0;
+
+    if (fresh == NULL)
+        return G_SOURCE_REMOVE;
+
+    TRACE_BEGIN(start);
+    int updated = playlist_update(&playlist, fresh, &stats);
+    TRACE_END("playlist_update", start);
+
+    if (updated)
+    {
+        printf("\nPlaylist refreshed: %u changed, %u added, %u removed\n", stats.changed, stats.added, stats.removed);
+
+        if (!headless)
+        {
+            fill_groups_list();
+            update_channel_list();
+            gtk_widget_queue_draw(GTK_WIDGET(chan_tree));
+        }
+
+        if (stats.changed != 0 || stats.added != 0)
+            search_index_build(&search_index, &playlist);
+
+        history_resolve();
+        candidates_build();
+    }
+
+    playlist_destroy(fresh);
+    free(fresh);
+    return G_SOURCE_REMOVE;
+}
+
+gpointer refresh_worker(gpointer data)
+{
+    playlist_t* fresh = (playlist_t*)malloc(sizeof(playlist_t));
+
+    if (fresh != NULL && read_playlists(refresh_sources, refresh_num_sources, fresh) == 0)
+    {
+        fprintf(stderr, "\nCannot refresh the playlist\n");
+        playlist_destroy(fresh);
+        free(fresh);
+        fresh = NULL;
+    }
+
+    g_idle_add(refresh_apply, fresh);
+    return NULL;
+}
+
+gboolean refresh_tick(gpointer data)
+{
+    // the first load must be over, and the previous refresh too
+    if (!playlist_streaming && !refresh_running)
+    {
+        refresh_running = 1;
+        g_thread_unref(g_thread_new("refresh", refresh_worker, NULL));
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+void refresh_init(char** sources, int num_sources)
+{
+    refresh_sources = sources;
+    refresh_num_sources = num_sources;
+
+    if (refresh_minutes > 0)
+        g_timeout_add_seconds(refresh_minutes * 60, refresh_tick, NULL);
+}
+
+// =====================================
+// STARTUP
+// =====================================
+
+// the window is shown right away: the playlist is read and libVLC scans its plugins (often 300+ ms)
+// in two threads meanwhile, and each is handed over to the GTK thread as soon as it is ready
+typedef struct startup_task {
+    GThread* thread;
+    uint8_t ready;      // handed over (or not needed)
+    int result;         // errno of a failure - 0 on success
+    int64_t done;
+} startup_task_t;
+
+int startup_result; // exit code if the playlist or libVLC could not be loaded
+
+static int64_t startup_began;
+static int64_t startup_shown;      // window mapped
+static startup_task_t startup_vlc;
+static startup_task_t startup_list; // not started when a remote playlist is streamed instead
+static playlist_t startup_playlist; // read by the worker, moved into 'playlist' once ready
+static char** startup_sources;
+static int startup_num_sources;
+
+gboolean startup_vlc_ready(gpointer data);
+gboolean startup_playlist_ready(gpointer data);
+
+gpointer startup_vlc_worker(gpointer data)
+{
+    const char* const vlc_params[] =
+    #ifdef _PLAYER_USE_XLIB_
+        {""};
+    #else
+        {"--no-xlib"};
+    #endif
+
+    vlc_inst = libvlc_new(1, vlc_params);
+    if (vlc_inst != NULL)
+        media_player = libvlc_media_player_new(vlc_inst);
+
+    if (media_player == NULL)
+    {
+        fprintf(stderr, "\nCannot initialize libVLC\n");
+        startup_vlc.result = (errno != 0) ? errno : ENOSYS;
+    }
+
+    startup_vlc.done = trace_now();
+
+    if (!headless)
+        g_idle_add(startup_vlc_ready, NULL);
+
+    return NULL;
+}
+
+gpointer startup_playlist_worker(gpointer data)
+{
+    if (read_playlists(startup_sources, startup_num_sources, &startup_playlist) == 0)
+        startup_list.result = (errno != 0) ? errno : ENOENT;
+
+    startup_list.done = trace_now();
+
+    if (!headless)
+        g_idle_add(startup_playlist_ready, NULL);
+
+    return NULL;
+}
+
+void startup_start(char** sources, int num_sources, int read_list)
+{
+    startup_began = trace_now();
+    startup_sources = sources;
+    startup_num_sources = num_sources;
+
+    startup_vlc.thread = g_thread_new("vlc", startup_vlc_worker, NULL);
+
+    if (read_list)
+    {
+        startup_list.thread = g_thread_new("playlist", startup_playlist_worker, NULL);
+        playlist_streaming = 1; // no refresh meanwhile
+    }
+    else
+        startup_list.ready = 1;
 }
 
-playlist_entry_t* playlist_new_entry(playlist_t* playlist, const char* group_name, const char* name, const char* logo, const char* url)
+void startup_join(startup_task_t* task, const char* trace_name)
 {
-    if (playlist == NULL || group_name == NULL) // sanity check
-        return NULL;
+    g_thread_join(task->thread);
+    task->thread = NULL;
+    task->ready = 1;
 
-    // find a group or create one
-    playlist_group_t* gro;
+    if (task == &startup_list)
+        playlist_streaming = 0;
 
-    if ((gro = playlist_find_group(playlist, group_name)) == NULL)    // try to find group
-        if ((gro = playlist_new_group(playlist, group_name)) == NULL) // try to create group
-            return NULL; // something went wrong...
-
-    return group_new_entry(gro, name, logo, url);
+    if (trace_enabled)
+        trace_complete(trace_name, startup_began, task->done);
 }
 
-void playlist_entry_destroy(playlist_entry_t* entry)
+// called once the window is up
+void startup_window_shown()
 {
-    if (entry == NULL) // sanity check
-        return;
-
-    free(entry->name);
-    free(entry->logo);
-    free(entry->url);
+    startup_shown = trace_now();
 }
 
-void playlist_group_destroy(playlist_group_t* gro)
+// both workers are over: channels can be played
+void startup_interactive()
 {
-    if (gro == NULL || gro->entries == NULL) // sanity check
+    if (!startup_vlc.ready || !startup_list.ready)
         return;
 
-    for (uint16_t e = 0; e < gro->num_entries; e++)
-        playlist_entry_destroy(&gro->entries[e]);
+    int64_t now = trace_now();
 
-    free(gro->entries);
-}
+    if (trace_enabled)
+        trace_complete("time_to_interactive", startup_began, now);
 
-void playlist_destroy(playlist_t* playlist)
-{
-    if (playlist == NULL || playlist->groups == NULL) // sanity check
-        return;
+    printf("\nInteractive after %.0f ms: window %.0f ms, libVLC %.0f ms", (now - startup_began) / 1000.0,
+           (startup_shown - startup_began) / 1000.0, (startup_vlc.done - startup_began) / 1000.0);
 
-    for (uint8_t g = 0; g < playlist->num_groups; g++)
-        playlist_group_destroy(&playlist->groups[g]);
+    if (startup_list.done != 0)
+        printf(", playlist %.0f ms", (startup_list.done - startup_began) / 1000.0);
 
-    free(playlist->groups);
+    printf("\n");
 }
 
-uint16_t read_playlist(const char* filename, playlist_t* playlist)
+gboolean startup_playlist_ready(gpointer data)
 {
-    // sanity check
-    if (filename == NULL || playlist == NULL)
-        return 0;
-    else
+    startup_join(&startup_list, "startup_playlist");
+
+    if (startup_list.result != 0)
     {
-        // fresh start
-        playlist->num_groups = 0;
-        playlist->groups = NULL;
+        startup_result = startup_list.result;
+        gtk_main_quit();
+        return G_SOURCE_REMOVE;
     }
 
-    // open the file
-    FILE* fp;
-    if ((fp = fopen(filename, "rb+")) == NULL)
-        return 0;
+    playlist = startup_playlist;
+    fill_groups_list();
+    update_channel_list();
+    playlist_loaded();
 
-    // parse file
-    uint16_t total_entries = 0;
-    char* line = NULL;
-    size_t buff_len = 0;
-    ssize_t read_len = 0;
+    startup_interactive();
+    return G_SOURCE_REMOVE;
+}
 
-    #define buff_size 512 // this buffers save the tag data from previous line (#extinf) to be used on the next lie (url)
-    char name[buff_size] = "";
-    char logo[buff_size] = "";
-    char group[buff_size] = "";
-    char args[buff_size] = "";
+gboolean startup_vlc_ready(gpointer data)
+{
+    startup_join(&startup_vlc, "startup_vlc");
 
-    while ((read_len = getline(&line, &buff_len, fp)) != -1)
+    if (startup_vlc.result != 0)
     {
-        if (line[0] == '#')
-        {
-            // check if comment or tag
-            if (sscanf(line, "#EXTINF:-1 %[^,],%[^\n\t]", args, name) != 2)
-                continue; // comment or bad tag
+        startup_result = startup_vlc.result;
+        gtk_main_quit();
+        return G_SOURCE_REMOVE;
+    }
 
-            // parse tag arguments
-            char* substr;
+    zap_init();
 
-            if ((substr = strstr(args, "tvg-logo=\"")) != NULL )
-                sscanf(substr + 10, "%[^\"]", logo);
-            else
-                strcpy(logo, "");
+    startup_interactive();
+    return G_SOURCE_REMOVE;
+}
 
-            if ((substr = strstr(args, "group-title=\"")) != NULL )
-                sscanf(substr + 13, "%[^\"]", group);
-            else
-                strcpy(logo, group);
+// headless: there is nothing to show meanwhile - returns 0 once both are ready
+int startup_wait()
+{
+    startup_join(&startup_vlc, "startup_vlc");
 
-            // do something to treat this line maybe?
-            //printf("\nName: %s\nLogo: %s\nGroup: %s\n", name, logo, group);
-        }
-        else
-        {
-            for (size_t i = 0;; i++) // remove new lines from text
-                if (line[i] == '\r' || line[i] == '\r')
-                    line[i] = '\0';
-                else if (line[i] == '\0')
-                    break;
+    if (startup_list.thread != NULL)
+        startup_join(&startup_list, "startup_playlist");
 
-            if (playlist_new_entry(playlist, group, name, logo, line) != NULL)
-                total_entries++;
-        }
-    }
+    if (startup_list.result == 0)
+        playlist = startup_playlist;
 
-    return total_entries;
+    startup_interactive();
+    return (startup_list.result != 0) ? startup_list.result : startup_vlc.result;
 }
 
-void playlist_print(playlist_t* playlist)
+// the window may be closed before the workers are over
+void startup_finish()
 {
-    for (uint8_t g = 0; g < playlist->num_groups; g++)
+    if (startup_list.thread != NULL)
     {
-        printf("\n\n%s:\n", playlist->groups[g].group_name);
-
-        for (uint16_t e = 0; e < playlist->groups[g].num_entries; e++)
-            printf("Name: %s\nLogo: %s\nUrl: %s\n", playlist->groups[g].entries[e].name, playlist->groups[g].entries[e].logo, playlist->groups[g].entries[e].url);
+        startup_join(&startup_list, "startup_playlist");
+        playlist_destroy(&startup_playlist);
     }
+
+    if (startup_vlc.thread != NULL)
+        startup_join(&startup_vlc, "startup_vlc");
 }
 
 // =====================================
-// LOGO DOWNLOAD
+// CONTROL SOCKET
 // =====================================
-void str_remove_special(const char* src, char* dst, size_t max_len)
-{
-    for (size_t i = 0; i < max_len; i++)
-    {
-        char c = src[i];
 
-        if (c == '\0')
-        {
-            dst[i] = '\0';
-            break;
-        }
-        else if (isdigit(c) || isalpha(c))
-            dst[i] = c;
-        else
-            dst[i] = '-';
-    }
-}
+// with --headless there is no window: the playlist is loaded, libVLC opens its own video output,
+// and the player is driven through a Unix socket, one command per line:
+//
+//   groups             <group>\t<channels>\t<name> for each group
+//   channels <group>   <channel>\t<tvg-id>\t<name> for each channel of the group
+//   play <group> <channel>
+//   stop
+//   status             <state>\t<group>\t<channel>\t<name> - group and channel are -1 if stopped
+//   metrics            per channel playback quality in the Prometheus text format, see PLAYBACK QUALITY
+//
+// every answer ends with a line "ok" or "error <reason>" (e.g. echo groups | socat - UNIX-CONNECT:cache/control.sock)
+char* control_path; // --control, path of the socket (default: cache/control.sock)
 
-GdkPixbuf* pixbuff_from_file(FILE* fp)
-{
-    if (fp == NULL) // sanity check
-        return NULL;
+#define CONTROL_MAX_LINE 1024
 
-    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
-    if (loader == NULL)
-    {
-        fprintf(stderr, "\nCould not create 'GdkPixbufLoader'\n");
-        return NULL;
-    }
+typedef struct control_client {
+    int fd;
+    GString* input;     // incomplete line
+} control_client_t;
 
-    size_t read;
-    uint8_t buffer[1024];
+static int control_group = -1;  // channel being played
+static int control_entry = -1;
 
-    while ((read = fread(buffer, sizeof(uint8_t), sizeof(buffer), fp )) > 0)
-    {
-        if (!gdk_pixbuf_loader_write(loader, buffer, read, NULL))
-        {
-            fprintf(stderr, "\ngdk_pixbuf_loader_write failed\n");
-            return NULL;
-        }
-    }
+static const char* const control_states[] = { "idle", "opening", "buffering", "playing", "paused", "stopped", "ended", "error" };
 
-    GdkPixbuf* pxb_1 = gdk_pixbuf_loader_get_pixbuf(loader);
+// answers are small and the peer is local, so they are written at once
+void control_write(control_client_t* client, const char* format, ...) __attribute__((format(printf, 2, 3)));
 
-    gdk_pixbuf_loader_close(loader, NULL);
+void control_write(control_client_t* client, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char* text = g_strdup_vprintf(format, args);
+    va_end(args);
 
-    if (pxb_1 == NULL)
+    size_t len = strlen(text);
+    for (size_t sent = 0; sent < len; )
     {
-        fprintf(stderr, "\ngdk_pixbuf_loader_get_pixbuf failed\n");
-        return NULL;
-    }
+        ssize_t n = send(client->fd, text + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            break; // client gone - noticed by the next read
 
-    GdkPixbuf* pxb_2 = gdk_pixbuf_scale_simple(pxb_1, 80, 80, GDK_INTERP_BILINEAR);
-
-    g_object_unref(pxb_1);
+        sent += n;
+    }
 
-    return pxb_2;
+    g_free(text);
 }
 
-FILE* cache_or_download_file(const char* url)
+int control_parse_ref(const char* arg, int* group, int* entry)
 {
-    // make sure the cache directory exists - if not, then we create it
-    static const char cache_dir[] = "cache";
-    static const char user_agent[] = "Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:81.0) Gecko/20100101 Firefox/81.0";
+    char* end;
 
-    struct stat st = {0};
+    *group = (int)strtol(arg, &end, 10);
+    if (end == arg || *group < 0 || *group >= (int)playlist.num_groups)
+        return 0;
 
-    if (stat(cache_dir, &st) == -1)
-    {
-        fprintf(stderr, "\nDirectory '%s' does not exist: ", cache_dir);
-        if (mkdir(cache_dir, 0777) == 0)
-            fprintf(stderr, "created\n");
-        else
-        {
-            fprintf(stderr, "%d %s", errno, strerror(errno));
-            return NULL;
-        }
-    }
+    if (entry == NULL)
+        return *end == '\0';
 
-    // check if the file exists in the cache
-    #define MAX_LEN_URL 100
-    char file_name[MAX_LEN_URL];
-    char parsed_url[MAX_LEN_URL - 6];
+    arg = end;
+    *entry = (int)strtol(arg, &end, 10);
 
-    str_remove_special(url, parsed_url, sizeof(parsed_url));
-    snprintf(file_name, sizeof(file_name),"%s/%s", cache_dir, parsed_url);
+    return end != arg && *end == '\0' && *entry >= 0 && *entry < (int)playlist.groups[*group].num_entries;
+}
 
+void control_command(control_client_t* client, char* line)
+{
+    char* arg = line + strcspn(line, " ");
+    if (*arg != '\0')
+        *arg++ = '\0';
 
-    FILE* fp = NULL;
+    int group, entry;
 
-    if (access(file_name, F_OK) != -1)
+    if (strcmp(line, "groups") == 0)
     {
-        // file is cached
-        open_cached:
-        if ((fp = fopen(file_name, "rb+")) == NULL)
-        {
-            fprintf(stderr, "\nFailed to open file '%s': %d %s\n", file_name, errno, strerror(errno));
-            goto download; // failed to open
-        }
-        else
-            return fp;
+        for (uint32_t g = 0; g < playlist.num_groups; g++)
+            control_write(client, "%u\t%u\t%s\n", g, playlist.groups[g].num_entries, playlist.groups[g].group_name);
     }
-    else
+    else if (strcmp(line, "channels") == 0)
     {
-        // file is not cached
-        download: (void)0;
-
-        CURL* curl = curl_easy_init();
-        if (curl == NULL)
-            return NULL; // cannot download
-
-        if ((fp = fopen(file_name, "wb")) == NULL)
+        if (!control_parse_ref(arg, &group, NULL))
         {
-            fprintf(stderr, "\nFailed to create file '%s': %d %s\n", file_name, errno, strerror(errno));
-            curl_easy_cleanup(curl);
-            return NULL; // could not create file
+            control_write(client, "error bad group\n");
+            return;
         }
 
-
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-
-        CURLcode result = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        fclose(fp); // close to save
-
-        if (result)
+        playlist_group_t* gro = &playlist.groups[group];
+        for (uint32_t e = 0; e < gro->num_entries; e++)
+            if (gro->entries[e].status != PLAYLIST_ENTRY_REMOVED)
+                control_write(client, "%u\t%s\t%s\n", e, gro->entries[e].id, gro->entries[e].name);
+    }
+    else if (strcmp(line, "play") == 0)
+    {
+        if (!control_parse_ref(arg, &group, &entry))
         {
-            // downlaod failed
-            fprintf(stderr, "\nCurl failed to download '%s' to '%s': \n", url, file_name);
-            remove(file_name);
-            return NULL;
+            control_write(client, "error bad channel\n");
+            return;
         }
-        else
-            printf("\n%s ==> %s", url, file_name);
-
-        // download succeeded - file is now cached
-        goto open_cached;
-    }
-}
-
-GdkPixbuf* get_channel_logo(playlist_entry_t* chan)
-{
-    if (chan->private_data)
-        return (GdkPixbuf*)chan->private_data;
-
-    FILE* fp = cache_or_download_file(chan->logo);
-
-    if (!fp)
-        return NULL;
-
-    GdkPixbuf* logo = pixbuff_from_file(fp);
-    fclose(fp);
 
-    chan->private_data = logo;
+        control_group = group;
+        control_entry = entry;
 
-    return logo;
-}
-
-// =====================================
-// GLOBAL
-// =====================================
-playlist_t playlist;
-
-int selected_group = 0;
-int selected_channel = 0;
-
-GtkBuilder* builder;
-GtkTreeView* chan_tree;
-GtkTreeView* cat_tree;
-GdkRectangle screen_rect;
-
-libvlc_instance_t *vlc_inst;
-libvlc_media_player_t* media_player;
-GtkWidget* channel_player;
-GtkWindow* main_window;
-
-// =====================================
-// GUI
-// =====================================
+        printf("\nPlay URL = '%s'\n", playlist.groups[group].entries[entry].url);
+        qos_opened(media_player, group, entry);
+        failover_play(media_player, 0, group, entry);
+        history_add(HISTORY_RECENT, group, entry, 0);
+    }
+    else if (strcmp(line, "stop") == 0)
+    {
+        control_group = control_entry = -1;
+        qos_closed(media_player);
+        failover_stop(media_player);
+        player_send(PLAYER_CMD_STOP, media_player, NULL, 0, NULL);
+    }
+    else if (strcmp(line, "status") == 0)
+    {
+        libvlc_state_t state = libvlc_media_player_get_state(media_player);
+        const char* name = (control_group < 0) ? "" : playlist.groups[control_group].entries[control_entry].name;
 
-void player_realize(GtkWidget* wid, gpointer data)
-{
-}
+        control_write(client, "%s\t%d\t%d\t%s\n", ((unsigned)state < G_N_ELEMENTS(control_states)) ? control_states[state] : "unknown",
+                      control_group, control_entry, name);
+    }
+    else if (strcmp(line, "metrics") == 0)
+    {
+        GString* text = g_string_new(NULL);
+        qos_export(text);
+        control_write(client, "%s", text->str);
+        g_string_free(text, TRUE);
+    }
+    else
+    {
+        control_write(client, "error unknown command\n");
+        return;
+    }
 
-void destroy(GtkWidget *widget, gpointer data) {
-    gtk_main_quit();
+    control_write(client, "ok\n");
 }
 
-void fill_groups_list()
+gboolean control_read(gint fd, GIOCondition condition, gpointer data)
 {
-    GtkTreeIter group_iter;
-    static GtkTreeStore *cat_store;
-
-    if (cat_store == NULL)
-        cat_store = GTK_TREE_STORE(gtk_builder_get_object(builder, "cat_store"));
+    control_client_t* client = (control_client_t*)data;
+    char buffer[4096];
+    ssize_t len = (condition & G_IO_IN) ? read(fd, buffer, sizeof(buffer)) : 0;
 
-    for (uint8_t group_index = 0; group_index < playlist.num_groups; group_index++)
+    if (len <= 0)
     {
-        gtk_tree_store_append(cat_store, &group_iter, NULL);
-        gtk_tree_store_set(cat_store, &group_iter, 0, playlist.groups[group_index].group_name, -1);
+        // disconnected
+        close(client->fd);
+        g_string_free(client->input, TRUE);
+        g_free(client);
+        return G_SOURCE_REMOVE;
     }
-}
 
-void fill_channel_list()
-{
-    GtkTreeIter chan_iter;
-    static GtkTreeStore *chan_store;
+    g_string_append_len(client->input, buffer, len);
 
-    if (chan_store == NULL)
-        chan_store = GTK_TREE_STORE(gtk_builder_get_object(builder, "chan_store"));
+    // commands are run as soon as their line is complete
+    char* eol;
+    while ((eol = memchr(client->input->str, '\n', client->input->len)) != NULL)
+    {
+        size_t line_len = eol - client->input->str;
+        char* line = g_strndup(client->input->str, line_len);
+        g_string_erase(client->input, 0, line_len + 1);
 
-    gtk_tree_store_clear(chan_store);
+        g_strstrip(line);
+        if (line[0] != '\0')
+            control_command(client, line);
 
-    playlist_group_t* gro = &playlist.groups[selected_group];
+        g_free(line);
+    }
 
-    for (uint8_t chan_index = 0; chan_index < gro->num_entries; chan_index++)
+    if (client->input->len > CONTROL_MAX_LINE)
     {
-        gtk_tree_store_append(chan_store, &chan_iter, NULL);
-        gtk_tree_store_set(chan_store, &chan_iter, 0, get_channel_logo(&gro->entries[chan_index]), 1, gro->entries[chan_index].name, -1);
+        control_write(client, "error line too long\n");
+        g_string_truncate(client->input, 0);
     }
+
+    return G_SOURCE_CONTINUE;
 }
 
-int get_sel_index(GtkWidget *c)
+gboolean control_accept(gint fd, GIOCondition condition, gpointer data)
 {
-    GtkTreeIter iter;
-    GtkTreeModel *model;
+    int client_fd = accept(fd, NULL, NULL);
+    if (client_fd < 0)
+        return G_SOURCE_CONTINUE;
 
-    if (!gtk_tree_selection_get_selected(GTK_TREE_SELECTION(c), &model, &iter))
-        return 0;
-
-    GtkTreePath* path = gtk_tree_model_get_path(model, &iter);
-    gint* i = gtk_tree_path_get_indices(path);
+    control_client_t* client = g_new(control_client_t, 1);
+    client->fd = client_fd;
+    client->input = g_string_new(NULL);
+    g_unix_fd_add(client_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, control_read, client);
 
-    return (int)i[0];
+    return G_SOURCE_CONTINUE;
 }
 
-void cat_sel_change(GtkWidget *c)
+int control_listen(const char* path)
 {
-    selected_group = get_sel_index(c);
-    fill_channel_list();
-}
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
 
-void chan_sel_change(GtkWidget *c)
-{
-    selected_channel = get_sel_index(c);
-    printf("channel = %s\n", playlist.groups[selected_group].entries[selected_channel].name);
-}
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "\nControl socket path too long: %s\n", path);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
 
-void player_url(const char* url, GtkWidget* wid)
-{
-    if (url == NULL ||  wid == NULL)
-        return;
+    strcpy(address.sun_path, path);
+    mkdir(cache_dir, 0777); // the default path is in it
+    unlink(path); // left by a previous run
 
-    if (libvlc_media_player_is_playing(media_player))
-        libvlc_media_player_stop(media_player);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
 
-    if (!gtk_widget_is_visible(wid))
-        gtk_widget_show(wid);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 8) != 0)
+    {
+        fprintf(stderr, "\nCannot listen on %s: %d %s\n", path, errno, strerror(errno));
 
-    libvlc_media_player_set_xwindow(media_player, GDK_WINDOW_XID(gtk_widget_get_window(wid)));
+        if (fd >= 0)
+            close(fd);
 
-    libvlc_media_t *media = libvlc_media_new_location(vlc_inst, url);
-    libvlc_media_player_set_media(media_player, media);
+        return -1;
+    }
 
-    libvlc_media_player_play(media_player);
-    libvlc_media_release(media);
+    return fd;
 }
 
+gboolean control_quit(gpointer data)
+{
+    g_main_loop_quit((GMainLoop*)data);
+    return G_SOURCE_REMOVE;
+}
 
-void player_do(uint8_t bOpen)
+// runs until SIGINT or SIGTERM
+int control_run(char** sources, int num_sources)
 {
-    if (bOpen)
-    {
-        static char* last_url;
-        char* url = playlist.groups[selected_group].entries[selected_channel].url;
+    char default_path[256];
+    snprintf(default_path, sizeof(default_path), "%s/control.sock", cache_dir);
 
-        printf("\nPlay URL = '%s'\n", url);
+    const char* path = (control_path != NULL) ? control_path : default_path;
+    int fd = control_listen(path);
 
-        if (libvlc_media_player_is_playing(media_player) && last_url == url) // repeate play command
-        {
-            gtk_widget_hide(channel_player);
-            player_url(url, GTK_WIDGET(main_window));
-        }
-        else
-        {
-            last_url = url;
-            player_url(url, channel_player);
-        }
-    }
-    else
-    {
-        libvlc_media_player_stop(media_player);
-        libvlc_media_player_set_media(media_player, NULL);
-        libvlc_media_player_set_xwindow(media_player, 0);
-        gtk_widget_hide(GTK_WIDGET(channel_player));
-    }
-}
+    if (fd < 0)
+        return errno;
 
-gboolean chan_tree_key(GtkWidget* widget, GdkEventKey *event, gpointer data)
-{
-    switch (event->keyval)
-    {
-        case GDK_KEY_Left:
-            gtk_widget_grab_focus(GTK_WIDGET(cat_tree));
-        break;
+    g_unix_fd_add(fd, G_IO_IN, control_accept, NULL);
+    printf("\nListening on %s\n", path);
 
-        case GDK_KEY_Return:
-            player_do(1);
-        break;
+    player_watch(media_player);
+    player_worker_start();
+    history_resolve();
+    candidates_build();
+    refresh_init(sources, num_sources);
 
-        case GDK_KEY_Escape:
-        case GDK_KEY_Home:
-        case GDK_KEY_BackSpace:
-            player_do(0);
-        break;
-    }
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    g_unix_signal_add(SIGINT, control_quit, loop);
+    g_unix_signal_add(SIGTERM, control_quit, loop);
 
-    return FALSE;
-}
+    g_main_loop_run(loop);
+    g_main_loop_unref(loop);
+    candidates_flush();
 
-gboolean cat_tree_key(GtkWidget* widget, GdkEventKey *event, gpointer data)
-{
-    switch (event->keyval)
-    {
-        case GDK_KEY_Right:
-        case GDK_KEY_Return:
-            gtk_widget_grab_focus(GTK_WIDGET(chan_tree));
-        break;
+    player_send(PLAYER_CMD_STOP, media_player, NULL, 0, NULL);
+    player_worker_stop();
 
-        case GDK_KEY_Escape:
-        case GDK_KEY_Home:
-        case GDK_KEY_BackSpace:
-            player_do(0);
-        break;
-    }
+    close(fd);
+    unlink(path);
 
-    return FALSE;
+    return 0;
 }
 
 // =====================================
 // MAIN
 // =====================================
+static GOptionEntry option_entries[] = {
+    { "logo-cache-mb", 0, 0, G_OPTION_ARG_INT, &logo_cache_mb, "Memory budget for decoded channel logos (default: 32)", "MB" },
+    { "logo-ttl", 0, 0, G_OPTION_ARG_INT, &logo_ttl_hours, "Hours before a cached logo is checked for a newer version (default: 168, 0 never)", "HOURS" },
+    { "logo-disk-mb", 0, 0, G_OPTION_ARG_INT, &logo_disk_mb, "Size of the logo cache on disk (default: 256, 0 unlimited)", "MB" },
+    { "zap-pool", 0, 0, G_OPTION_ARG_INT, &zap_pool_size, "Players kept open for fast zapping: the current channel and its neighbours (default: 3, 1 disables)", "N" },
+    { "profile", 0, 0, G_OPTION_ARG_STRING, &player_profile_name, "Stream caching profile: low-latency, balanced or robust (default: balanced)", "NAME" },
+    { "group-profile", 0, 0, G_OPTION_ARG_STRING_ARRAY, &player_group_profiles, "Caching profile for the channels of one group, may be repeated", "GROUP=NAME" },
+    { "probe-rate", 0, 0, G_OPTION_ARG_INT, &probe_rate, "Channels of the selected group checked per second in background (default: 10, 0 disables)", "N" },
+    { "epg", 0, 0, G_OPTION_ARG_STRING, &epg_source, "Program guide of the channels: XMLTV file or url, may be gzipped", "FILE|URL" },
+    { "epg-hours", 0, 0, G_OPTION_ARG_INT, &epg_hours, "Hours of the program guide kept in memory (default: 24)", "N" },
+    { "parse-threads", 0, 0, G_OPTION_ARG_INT, &m3u_parse_threads, "Threads parsing big local playlists (default: 0, one per core; 1 disables)", "N" },
+    { "refresh", 0, 0, G_OPTION_ARG_INT, &refresh_minutes, "Minutes between reloads of the playlist, picking up changed stream urls (default: 0, never)", "MIN" },
+    { "failover-timeout", 0, 0, G_OPTION_ARG_INT, &failover_timeout, "Seconds without a picture before another copy of the channel is tried (default: 6, 0 only on errors)", "SEC" },
+    { "qos-log", 0, 0, G_OPTION_ARG_INT, &qos_log_seconds, "Seconds between log lines with the playback quality of the open channels (default: 0, never)", "SEC" },
+    { "headless", 0, 0, G_OPTION_ARG_NONE, &headless, "No window: the player is driven through the control socket", NULL },
+    { "control", 0, 0, G_OPTION_ARG_FILENAME, &control_path, "Path of the control socket in headless mode (default: cache/control.sock)", "PATH" },
+    { "hw-decode", 0, 0, G_OPTION_ARG_STRING, &player_hw_decode, "Hardware decoder: any, none, vaapi, vdpau... (default: any)", "NAME" },
+    { NULL }
+};
+
 int main(int argc, char** argv)
 {
-    // sanity check
-    if (argc != 2)
+    trace_init();
+
+    // command line options
+    GError* error = NULL;
+    GOptionContext* options = g_option_context_new("filename.m3u|http://url.m3u...");
+    g_option_context_add_main_entries(options, option_entries, NULL);
+    g_option_context_add_group(options, gtk_get_option_group(FALSE));
+
+    if (!g_option_context_parse(options, &argc, &argv, &error))
     {
-        fprintf(stderr, "\nUsage: %s filename.m3u\n", argv[0]);
+        fprintf(stderr, "\n%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(options);
         return EINVAL;
     }
 
-    // load playlist
-    if ( (read_playlist(argv[1], &playlist)) == 0)
-        return errno;
+    g_option_context_free(options);
 
-    //playlist_print(&playlist);
+    if (!player_profiles_init())
+        return EINVAL;
 
-    // Create GUI
-    // ==================================================
+    // sanity check
+    if (argc < 2)
+    {
+        fprintf(stderr, "\nUsage: %s [options] filename.m3u|http://url.m3u...\n", argv[0]);
+        return EINVAL;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    history_init();
+    candidates_init();
 
-    // setup vlc
-    const char* const vlc_params[] =
     #ifdef _PLAYER_USE_XLIB_
-       {""};
-    XInitThreads();
-    #else
-        {"--no-xlib"};
+    XInitThreads(); // before libVLC and GTK use Xlib from their threads
     #endif
 
-    vlc_inst = libvlc_new(1, vlc_params);
-    media_player = libvlc_media_player_new(vlc_inst);
+    // load playlist and vlc while the GUI is built - a single remote playlist is streamed once it is up
+    int streaming = (!headless && argc == 2 && playlist_is_url(argv[1]));
+    startup_start(argv + 1, argc - 1, !streaming);
+    qos_init(); // sampled by the main loop of either mode
+
+    // kiosk: neither GTK nor the logos are initialized
+    if (headless)
+    {
+        int result = startup_wait();
+        if (result != 0)
+            return result;
+
+        result = control_run(argv + 1, argc - 1);
+
+        libvlc_media_player_release(media_player);
+        libvlc_release(vlc_inst);
+        playlist_destroy(&playlist);
+        return result;
+    }
 
     // main window
     gtk_init (&argc, &argv);
 
+    // logos are downloaded in background threads
+    logo_pipeline_init();
+    probe_init();
+
     GtkCssProvider *css = gtk_css_provider_new();
     if (css == NULL)
     {
@@ -665,6 +5355,7 @@ int main(int argc, char** argv)
     
     gtk_style_context_add_provider_for_screen(gdk_screen_get_default(), GTK_STYLE_PROVIDER(css), GTK_STYLE_PROVIDER_PRIORITY_USER);
 
+    g_type_ensure(LOGO_TYPE_RENDERER); // instantiated by the layout
     builder = gtk_builder_new_from_file(layout_path);
     if (builder == NULL)
     {
@@ -686,20 +5377,40 @@ int main(int argc, char** argv)
 
     chan_tree = GTK_TREE_VIEW(gtk_builder_get_object(builder, "chan_tree"));
     cat_tree = GTK_TREE_VIEW(gtk_builder_get_object(builder, "cat_tree"));
+    chan_model = CHAN_MODEL(g_object_new(CHAN_TYPE_MODEL, NULL));
+    gtk_tree_view_set_model(chan_tree, GTK_TREE_MODEL(chan_model));
     channel_player = GTK_WIDGET(gtk_builder_get_object(builder, "player_area"));
+    search_entry = GTK_SEARCH_ENTRY(gtk_builder_get_object(builder, "search_entry"));
+
+    // channels list - filled as the playlist arrives, the players are created once libVLC is ready
+    if (streaming && !playlist_stream_start(argv[1]))
+        return -1;
 
-    // channels list
     fill_groups_list();
 
     // main GTK
     gtk_widget_show_all(GTK_WIDGET(main_window));
     gtk_widget_grab_focus(GTK_WIDGET(cat_tree));
+    startup_window_shown();
+    g_timeout_add_seconds(60, epg_tick, NULL);
+    refresh_init(argv + 1, argc - 1);
     gtk_main ();
 
+    candidates_flush();
+    logo_cache_report();
+    trace_finish();
+
     // cleanup
-    libvlc_media_player_release(media_player);
-    libvlc_release(vlc_inst);
+    startup_finish();
+    probe_shutdown();
+    zap_release();
+
+    if (vlc_inst != NULL)
+        libvlc_release(vlc_inst);
+
+    search_index_destroy(&search_index);
+    epg_free(epg);
     playlist_destroy(&playlist);
-    return 0;
+    return startup_result;
 }
 
@@ -0,0 +1,1745 @@
+/* ===================================================================================  //
+//    This program is free software: you can redistribute it and/or modify              //
+//    it under the terms of the GNU General Public License as published by              //
+//    the Free Software Foundation, either version 3 of the License, or                 //
+//    (at your option) any later version.                                               //
+//                                                                                      //
+//    This program is distributed in the hope that it will be useful,                   //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                    //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                     //
+//    GNU General Public License for more details.                                      //
+//                                                                                      //
+//    You should have received a copy of the GNU General Public License                 //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//    Copyright: Luiz Gustavo Pfitscher e Feldmann, 2020                                //
+// ===================================================================================  */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <strings.h>
+#include <pthread.h>
+#include "playlist.h"
+
+// =====================================
+// PLAYLIST
+// =====================================
+
+// strings of the playlist are copied into large blocks and released all at once
+#define PLAYLIST_BLOCK_SIZE (64*1024)
+
+void playlist_init(playlist_t* playlist)
+{
+    *playlist = (playlist_t) {
+        .num_groups = 0,
+        .max_groups = 0,
+        .groups = NULL,
+        .group_index = NULL,
+        .index_size = 0,
+        .blocks = NULL,
+        .alternates = { 0 },
+        .map = NULL,
+        .map_len = 0,
+    };
+}
+
+// FNV-1a
+uint32_t playlist_hash(const char* str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t)str[i]) * 16777619u;
+
+    return hash;
+}
+
+// places a group in the first free slot of its probe sequence
+static void playlist_index_insert(playlist_t* playlist, uint32_t group)
+{
+    uint32_t mask = playlist->index_size - 1;
+    uint32_t slot = playlist->groups[group].name_hash & mask;
+
+    while (playlist->group_index[slot] != 0)
+        slot = (slot + 1) & mask;
+
+    playlist->group_index[slot] = group + 1;
+}
+
+// makes sure the index stays at most 3/4 full after one more group is added
+static int playlist_index_reserve(playlist_t* playlist)
+{
+    if ((uint64_t)(playlist->num_groups + 1) * 4 <= (uint64_t)playlist->index_size * 3)
+        return 1;
+
+    uint32_t new_size = (playlist->index_size == 0) ? 64 : playlist->index_size * 2;
+    uint32_t* new_index = (uint32_t*)calloc(new_size, sizeof(uint32_t));
+
+    if (new_index == NULL)
+        return 0;
+
+    free(playlist->group_index);
+    playlist->group_index = new_index;
+    playlist->index_size = new_size;
+
+    for (uint32_t g = 0; g < playlist->num_groups; g++)
+        playlist_index_insert(playlist, g);
+
+    return 1;
+}
+
+// copies 'len' characters from 'str' and terminates the copy
+char* playlist_strndup(playlist_t* playlist, const char* str, size_t len)
+{
+    playlist_block_t* block = playlist->blocks;
+
+    if (block == NULL || block->size - block->used < len + 1)
+    {
+        // current block is full: start a new one (big strings get a block of their own)
+        size_t size = (len > PLAYLIST_BLOCK_SIZE) ? len : PLAYLIST_BLOCK_SIZE;
+
+        if ((block = (playlist_block_t*)malloc(sizeof(playlist_block_t) + size + 1)) == NULL)
+            return NULL;
+
+        block->used = 0;
+        block->size = size;
+        block->next = playlist->blocks;
+        playlist->blocks = block;
+    }
+
+    char* copy = &block->data[block->used];
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+
+    return copy;
+}
+
+char* playlist_strdup(playlist_t* playlist, const char* str)
+{
+    return playlist_strndup(playlist, str, strlen(str));
+}
+
+// makes sure there is room for 'count + 1' elements in the array, doubling its capacity when needed
+void* playlist_grow(void* array, size_t elem_size, uint32_t count, uint32_t* capacity)
+{
+    if (count < *capacity)
+        return array;
+
+    uint32_t new_capacity = (*capacity == 0) ? 8 : *capacity * 2;
+    void* new_array = realloc(array, new_capacity * elem_size);
+
+    if (new_array != NULL)
+        *capacity = new_capacity;
+
+    return new_array;
+}
+
+// the name does not need to be terminated, so the parser can look groups up straight from the file
+static playlist_group_t* playlist_find_group_n(playlist_t* playlist, const char* group_name, size_t len)
+{
+    if (playlist == NULL || group_name == NULL) // sanity check
+        return NULL;
+
+    if (playlist->index_size == 0)
+        return NULL; // no groups yet
+
+    uint32_t hash = playlist_hash(group_name, len);
+    uint32_t mask = playlist->index_size - 1;
+
+    // linear probing until an empty slot
+    for (uint32_t slot = hash & mask; playlist->group_index[slot] != 0; slot = (slot + 1) & mask)
+    {
+        playlist_group_t* gro = &playlist->groups[playlist->group_index[slot] - 1];
+
+        if (gro->name_hash == hash && strncmp(gro->group_name, group_name, len) == 0 && gro->group_name[len] == '\0')
+            return gro;
+    }
+
+    return NULL;
+}
+
+playlist_group_t* playlist_find_group(playlist_t* playlist, const char* group_name)
+{
+    if (group_name == NULL) // sanity check
+        return NULL;
+
+    return playlist_find_group_n(playlist, group_name, strlen(group_name));
+}
+
+// adds a group whose name is already stored (in the blocks or in a snapshot) and is not in the playlist yet
+static playlist_group_t* playlist_add_group(playlist_t* playlist, char* group_name, size_t len)
+{
+    // make room for new group struct in the playlist
+    playlist_group_t* new_list = (playlist_group_t*)playlist_grow(playlist->groups, sizeof(playlist_group_t), playlist->num_groups, &playlist->max_groups);
+    if (new_list == NULL)
+        return NULL;
+    else
+        playlist->groups = new_list;
+
+    if (!playlist_index_reserve(playlist))
+        return NULL;
+
+    // setup group
+    playlist_group_t* new_group = &playlist->groups[playlist->num_groups];
+    new_group->num_entries = 0;
+    new_group->max_entries = 0;
+    new_group->entries = NULL;
+    new_group->group_name = group_name;
+    new_group->name_hash = playlist_hash(group_name, len);
+
+    playlist_index_insert(playlist, playlist->num_groups++);
+
+    return new_group;
+}
+
+playlist_group_t* playlist_new_group_n(playlist_t* playlist, const char* group_name, size_t len)
+{
+    if (playlist == NULL || group_name == NULL) // sanity check
+        return NULL;
+
+    char* name_copy = playlist_strndup(playlist, group_name, len);
+    if (name_copy == NULL)
+        return NULL;
+
+    return playlist_add_group(playlist, name_copy, len);
+}
+
+playlist_group_t* playlist_new_group(playlist_t* playlist, const char* group_name)
+{
+    if (group_name == NULL) // sanity check
+        return NULL;
+
+    return playlist_new_group_n(playlist, group_name, strlen(group_name));
+}
+
+// returns a blank slot at the end of the group
+static playlist_entry_t* group_append_entry(playlist_group_t* g)
+{
+    // make room in list for new entry
+    playlist_entry_t* new_pl = (playlist_entry_t*)playlist_grow(g->entries, sizeof(playlist_entry_t), g->num_entries, &g->max_entries);
+    if (new_pl == NULL) // could not reallocate
+        return NULL;
+    else
+        g->entries = new_pl;
+
+    playlist_entry_t* new_entry = &g->entries[g->num_entries++];
+    memset(new_entry, 0, sizeof(playlist_entry_t));
+
+    return new_entry;
+}
+
+playlist_entry_t* group_new_entry(playlist_t* playlist, playlist_group_t* g, const char* name, const char* logo, const char* id, const char* url)
+{
+    if (playlist == NULL || g == NULL || name == NULL  || logo == NULL || id == NULL || url == NULL) // sanity check
+        return NULL;
+
+    // copy the content from temp buffer to inside the (permanent) playlist storage
+    playlist_entry_t entry = {
+        .name  = playlist_strdup(playlist, name),
+        .logo  = playlist_strdup(playlist, logo),
+        .id    = playlist_strdup(playlist, id),
+        .url   = playlist_strdup(playlist, url),
+    };
+
+    if (entry.name == NULL || entry.logo == NULL || entry.id == NULL || entry.url == NULL)
+        return NULL;
+
+    playlist_entry_t* new_entry = group_append_entry(g);
+    if (new_entry != NULL)
+        *new_entry = entry;
+
+    return new_entry;
+}
+
+playlist_entry_t* playlist_new_entry(playlist_t* playlist, const char* group_name, const char* name, const char* logo, const char* id, const char* url)
+{
+    if (playlist == NULL || group_name == NULL) // sanity check
+        return NULL;
+
+    // find a group or create one
+    playlist_group_t* gro;
+
+    if ((gro = playlist_find_group(playlist, group_name)) == NULL)    // try to find group
+        if ((gro = playlist_new_group(playlist, group_name)) == NULL) // try to create group
+            return NULL; // something went wrong...
+
+    return group_new_entry(playlist, gro, name, logo, id, url);
+}
+
+void playlist_destroy(playlist_t* playlist)
+{
+    if (playlist == NULL) // sanity check
+        return;
+
+    for (uint32_t g = 0; g < playlist->num_groups; g++)
+        free(playlist->groups[g].entries);
+
+    free(playlist->groups);
+    free(playlist->group_index);
+    free(playlist->alternates.entries);
+
+    // strings are released block by block
+    playlist_block_t* block = playlist->blocks;
+    while (block != NULL)
+    {
+        playlist_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    if (playlist->map != NULL)
+        munmap(playlist->map, playlist->map_len);
+
+    playlist_init(playlist);
+}
+
+void playlist_print(playlist_t* playlist)
+{
+    for (uint32_t g = 0; g < playlist->num_groups; g++)
+    {
+        printf("\n\n%s:\n", playlist->groups[g].group_name);
+
+        for (uint32_t e = 0; e < playlist->groups[g].num_entries; e++)
+            printf("Name: %s\nLogo: %s\nId: %s\nUrl: %s\n", playlist->groups[g].entries[e].name, playlist->groups[g].entries[e].logo, playlist->groups[g].entries[e].id, playlist->groups[g].entries[e].url);
+    }
+}
+
+// =====================================
+// PLAYLIST UPDATE
+// =====================================
+
+// applies a newer version of the playlist in place: entries are matched by group, name and tvg-id, so
+// existing entries keep their position (selection, channels playing and cached logos stay valid)
+
+static uint32_t playlist_entry_hash(const playlist_entry_t* entry)
+{
+    return playlist_hash(entry->name, strlen(entry->name)) * 31u + playlist_hash(entry->id, strlen(entry->id));
+}
+
+// replaces the string if it changed, copying the new one into the playlist - returns 1 if replaced
+static int playlist_update_string(playlist_t* playlist, char** str, const char* fresh)
+{
+    if (strcmp(*str, fresh) == 0)
+        return 0;
+
+    char* copy = playlist_strdup(playlist, fresh);
+    if (copy == NULL)
+        return 0;
+
+    *str = copy;
+    return 1;
+}
+
+// 'matched' flags the entries of the group found in the fresh one, which must have room for all of them
+static int playlist_update_group(playlist_t* playlist, playlist_group_t* g, const playlist_group_t* fresh, uint8_t* matched, playlist_update_stats_t* stats)
+{
+    uint32_t num_old = g->num_entries;
+    uint32_t size = 16;
+
+    while (size < num_old * 2)
+        size *= 2;
+
+    // entries which were there before, by name and tvg-id (index + 1, 0 is free)
+    uint32_t* table = (uint32_t*)calloc(size, sizeof(uint32_t));
+    if (table == NULL)
+        return 0;
+
+    for (uint32_t e = 0; e < num_old; e++)
+    {
+        uint32_t slot = playlist_entry_hash(&g->entries[e]) & (size - 1);
+
+        while (table[slot] != 0)
+            slot = (slot + 1) & (size - 1);
+
+        table[slot] = e + 1;
+    }
+
+    memset(matched, 0, num_old);
+
+    for (uint32_t f = 0; f < fresh->num_entries; f++)
+    {
+        const playlist_entry_t* entry = &fresh->entries[f];
+        uint32_t slot = playlist_entry_hash(entry) & (size - 1);
+        uint32_t found = 0;
+
+        // channels listed twice with the same name are matched in order
+        for (; table[slot] != 0; slot = (slot + 1) & (size - 1))
+        {
+            uint32_t e = table[slot] - 1;
+
+            if (!matched[e] && strcmp(g->entries[e].name, entry->name) == 0 && strcmp(g->entries[e].id, entry->id) == 0)
+            {
+                found = table[slot];
+                break;
+            }
+        }
+
+        if (found == 0)
+        {
+            if (group_new_entry(playlist, g, entry->name, entry->logo, entry->id, entry->url) != NULL)
+                stats->added++;
+
+            continue;
+        }
+
+        playlist_entry_t* old = &g->entries[found - 1];
+        matched[found - 1] = 1;
+
+        int url_changed = playlist_update_string(playlist, &old->url, entry->url);
+        int logo_changed = playlist_update_string(playlist, &old->logo, entry->logo);
+
+        if (url_changed || old->status == PLAYLIST_ENTRY_REMOVED)
+            old->status = 0; // not probed yet
+
+        if (url_changed || logo_changed)
+            stats->changed++;
+    }
+
+    free(table);
+    return 1;
+}
+
+static void playlist_update_removed(playlist_group_t* g, const uint8_t* matched, uint32_t num_old, playlist_update_stats_t* stats)
+{
+    for (uint32_t e = 0; e < num_old; e++)
+        if ((matched == NULL || !matched[e]) && g->entries[e].status != PLAYLIST_ENTRY_REMOVED)
+        {
+            g->entries[e].status = PLAYLIST_ENTRY_REMOVED;
+            stats->removed++;
+        }
+}
+
+// entries missing from the fresh playlist are not deleted (it would shift the positions) but marked removed
+int playlist_update(playlist_t* playlist, const playlist_t* fresh, playlist_update_stats_t* stats)
+{
+    uint32_t num_old_groups = playlist->num_groups;
+    uint8_t* seen = (uint8_t*)calloc(num_old_groups + 1, 1);
+    uint8_t* matched = NULL;
+    uint32_t max_matched = 0;
+
+    memset(stats, 0, sizeof(playlist_update_stats_t));
+
+    if (seen == NULL)
+        return 0;
+
+    for (uint32_t f = 0; f < fresh->num_groups; f++)
+    {
+        const playlist_group_t* fg = &fresh->groups[f];
+        playlist_group_t* g = playlist_find_group(playlist, fg->group_name);
+
+        if (g == NULL && (g = playlist_new_group(playlist, fg->group_name)) == NULL)
+            continue;
+
+        uint32_t index = g - playlist->groups;
+        uint32_t num_old = g->num_entries;
+
+        if (index < num_old_groups)
+            seen[index] = 1;
+
+        if (num_old + 1 > max_matched)
+        {
+            uint8_t* grown = (uint8_t*)realloc(matched, num_old + 1);
+            if (grown == NULL)
+                continue;
+
+            matched = grown;
+            max_matched = num_old + 1;
+        }
+
+        if (playlist_update_group(playlist, g, fg, matched, stats))
+            playlist_update_removed(g, matched, num_old, stats);
+    }
+
+    // groups which disappeared altogether
+    for (uint32_t g = 0; g < num_old_groups; g++)
+        if (!seen[g])
+            playlist_update_removed(&playlist->groups[g], NULL, playlist->groups[g].num_entries, stats);
+
+    // the alternates are matched the same way, but are not part of the changes of the list
+    uint32_t num_alternates = playlist->alternates.num_entries;
+    uint8_t* alternates_matched = (num_alternates + 1 > max_matched) ? (uint8_t*)realloc(matched, num_alternates + 1) : matched;
+
+    if (alternates_matched != NULL)
+    {
+        playlist_update_stats_t alternates_stats;
+        memset(&alternates_stats, 0, sizeof(alternates_stats));
+        matched = alternates_matched;
+
+        if (playlist_update_group(playlist, &playlist->alternates, &fresh->alternates, matched, &alternates_stats))
+            playlist_update_removed(&playlist->alternates, matched, num_alternates, &alternates_stats);
+    }
+
+    free(matched);
+    free(seen);
+    return 1;
+}
+
+static int playlist_key_set_grow(playlist_key_set_t* set)
+{
+    uint32_t new_size = (set->size == 0) ? 1024 : set->size * 2;
+    const char** keys = (const char**)calloc(new_size, sizeof(const char*));
+    uint32_t* tags = (uint32_t*)calloc(new_size, sizeof(uint32_t));
+
+    if (keys == NULL || tags == NULL)
+    {
+        free(keys);
+        free(tags);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < set->size; i++)
+    {
+        if (set->keys[i] == NULL)
+            continue;
+
+        uint32_t slot = playlist_hash(set->keys[i], strlen(set->keys[i])) & (new_size - 1);
+
+        while (keys[slot] != NULL)
+            slot = (slot + 1) & (new_size - 1);
+
+        keys[slot] = set->keys[i];
+        tags[slot] = set->tags[i];
+    }
+
+    free(set->keys);
+    free(set->tags);
+
+    set->keys = keys;
+    set->tags = tags;
+    set->size = new_size;
+    return 1;
+}
+
+// returns the tag of the key - NULL if not in the set
+static const uint32_t* playlist_key_set_find(const playlist_key_set_t* set, const char* key)
+{
+    if (set->size == 0)
+        return NULL;
+
+    for (uint32_t slot = playlist_hash(key, strlen(key)) & (set->size - 1); set->keys[slot] != NULL; slot = (slot + 1) & (set->size - 1))
+        if (strcmp(set->keys[slot], key) == 0)
+            return &set->tags[slot];
+
+    return NULL;
+}
+
+// the key must not be in the set yet
+static int playlist_key_set_insert(playlist_key_set_t* set, const char* key, uint32_t tag)
+{
+    if ((uint64_t)(set->count + 1) * 4 > (uint64_t)set->size * 3 && !playlist_key_set_grow(set))
+        return 0;
+
+    uint32_t slot = playlist_hash(key, strlen(key)) & (set->size - 1);
+
+    while (set->keys[slot] != NULL)
+        slot = (slot + 1) & (set->size - 1);
+
+    set->keys[slot] = key;
+    set->tags[slot] = tag;
+    set->count++;
+    return 1;
+}
+
+static void playlist_key_set_destroy(playlist_key_set_t* set)
+{
+    free(set->keys);
+    free(set->tags);
+    memset(set, 0, sizeof(playlist_key_set_t));
+}
+
+void playlist_merge_init(playlist_merge_t* merge)
+{
+    memset(merge, 0, sizeof(playlist_merge_t));
+}
+
+void playlist_merge_destroy(playlist_merge_t* merge)
+{
+    playlist_key_set_destroy(&merge->urls);
+    playlist_key_set_destroy(&merge->ids);
+}
+
+// appends the groups and entries of 'src' to 'dst' - returns how many entries were added
+// groups keep the order they are first seen in, and an entry is dropped if its url was already added;
+// if its tvg-id was already added by another source (one source may list a tvg-id twice, e.g. in SD and HD)
+// it is not listed either, but kept in the alternates of 'dst' to fall back to
+uint32_t playlist_merge_add(playlist_merge_t* merge, playlist_t* dst, const playlist_t* src, uint32_t source)
+{
+    uint32_t added = 0;
+
+    for (uint32_t g = 0; g < src->num_groups; g++)
+    {
+        const playlist_group_t* sg = &src->groups[g];
+        playlist_group_t* dg = playlist_find_group(dst, sg->group_name);
+
+        if (dg == NULL && (dg = playlist_new_group(dst, sg->group_name)) == NULL)
+            continue;
+
+        for (uint32_t e = 0; e < sg->num_entries; e++)
+        {
+            const playlist_entry_t* entry = &sg->entries[e];
+            const uint32_t* id_source = (entry->id[0] == '\0') ? NULL : playlist_key_set_find(&merge->ids, entry->id);
+
+            if (playlist_key_set_find(&merge->urls, entry->url) != NULL)
+            {
+                merge->duplicates++;
+                continue;
+            }
+
+            int alternate = (id_source != NULL && *id_source != source);
+
+            playlist_entry_t* copy = group_new_entry(dst, alternate ? &dst->alternates : dg, entry->name, entry->logo, entry->id, entry->url);
+            if (copy == NULL)
+                continue;
+
+            // the sets refer to the copies, which live as long as 'dst'
+            playlist_key_set_insert(&merge->urls, copy->url, source);
+
+            if (alternate)
+            {
+                merge->alternates++;
+                continue;
+            }
+
+            if (copy->id[0] != '\0' && id_source == NULL)
+                playlist_key_set_insert(&merge->ids, copy->id, source);
+
+            added++;
+        }
+    }
+
+    return added;
+}
+
+// =====================================
+// PLAYLIST SNAPSHOT
+// =====================================
+
+// the parsed playlist is saved in binary form so the next start does not need to parse the text again
+const char cache_dir[] = "cache";
+
+#define PLAYLIST_SNAPSHOT_MAGIC   0x5355334d // "M3US"
+#define PLAYLIST_SNAPSHOT_VERSION 1
+
+// layout: header, source name, groups, entries, strings - offsets are relative to the string table
+typedef struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    snapshot_key_t key;
+    uint32_t source_len;    // including terminator, padded to 8 bytes
+    uint32_t num_groups;
+    uint64_t num_entries;
+    uint64_t strings_len;
+} snapshot_header_t;
+
+typedef struct snapshot_group {
+    uint64_t name;
+    uint32_t num_entries;
+    uint32_t reserved;
+} snapshot_group_t;
+
+typedef struct snapshot_entry {
+    uint64_t url;
+    uint64_t name;
+    uint64_t logo;
+    uint64_t id;
+} snapshot_entry_t;
+
+static void playlist_snapshot_path(const char* source, char* path, size_t max_len)
+{
+    snprintf(path, max_len, "%s/playlist-%08x.bin", cache_dir, playlist_hash(source, strlen(source)));
+}
+
+static size_t snapshot_source_len(const char* source)
+{
+    return (strlen(source) + 1 + 7) & ~(size_t)7;
+}
+
+// maps the snapshot of 'source' and checks the header - returns NULL if missing or from another version
+static const snapshot_header_t* playlist_snapshot_map(const char* source, size_t* map_len)
+{
+    char path[256];
+    playlist_snapshot_path(source, path, sizeof(path));
+
+    int fd;
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return NULL;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(snapshot_header_t))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return NULL;
+
+    const snapshot_header_t* header = (const snapshot_header_t*)map;
+    size_t len = st.st_size;
+
+    // check the whole layout fits in the file before trusting any offset
+    uint64_t expected = sizeof(snapshot_header_t) + (uint64_t)header->source_len
+                      + (uint64_t)header->num_groups * sizeof(snapshot_group_t)
+                      + header->num_entries * sizeof(snapshot_entry_t) + header->strings_len;
+
+    const char* stored_source = (const char*)(header + 1);
+
+    if (header->magic != PLAYLIST_SNAPSHOT_MAGIC || header->version != PLAYLIST_SNAPSHOT_VERSION
+        || header->source_len != snapshot_source_len(source) || expected != len
+        || strcmp(stored_source, source) != 0 || header->strings_len == 0
+        || ((const char*)map)[len - 1] != '\0')
+    {
+        munmap(map, len);
+        return NULL;
+    }
+
+    *map_len = len;
+    return header;
+}
+
+// reads the key of the current snapshot, e.g. to ask the server whether the playlist changed since
+static int playlist_snapshot_key(const char* source, snapshot_key_t* key)
+{
+    size_t map_len;
+    const snapshot_header_t* header = playlist_snapshot_map(source, &map_len);
+
+    if (header == NULL)
+        return 0;
+
+    *key = header->key;
+    munmap((void*)header, map_len);
+
+    return 1;
+}
+
+// builds the playlist on top of the mapped snapshot (no parsing, strings are not copied)
+// if 'key' is given, the snapshot is only used if it was made from that version of the source
+static uint32_t playlist_snapshot_load(const char* source, const snapshot_key_t* key, playlist_t* playlist)
+{
+    size_t map_len;
+    const snapshot_header_t* header = playlist_snapshot_map(source, &map_len);
+
+    if (header == NULL)
+        return 0;
+
+    if (key != NULL && (header->key.size != key->size || header->key.mtime != key->mtime || strcmp(header->key.etag, key->etag) != 0))
+    {
+        munmap((void*)header, map_len); // stale
+        return 0;
+    }
+
+    const snapshot_group_t* groups = (const snapshot_group_t*)((const char*)(header + 1) + header->source_len);
+    const snapshot_entry_t* entries = (const snapshot_entry_t*)(groups + header->num_groups);
+    const char* strings = (const char*)(entries + header->num_entries);
+
+    playlist_init(playlist);
+    playlist->map = (void*)header;
+    playlist->map_len = map_len;
+
+    #define SNAPSHOT_STR(off) (((off) < header->strings_len) ? (char*)&strings[off] : NULL)
+
+    uint64_t first = 0;
+    for (uint32_t g = 0; g < header->num_groups; g++)
+    {
+        char* name = SNAPSHOT_STR(groups[g].name);
+
+        if (name == NULL || first + groups[g].num_entries > header->num_entries)
+            goto corrupt;
+
+        // group names were unique when saved - the name stays in the snapshot
+        playlist_group_t* gro = playlist_add_group(playlist, name, strlen(name));
+        if (gro == NULL)
+            goto corrupt;
+
+        gro->entries = (playlist_entry_t*)calloc(groups[g].num_entries, sizeof(playlist_entry_t));
+        if (gro->entries == NULL && groups[g].num_entries > 0)
+            goto corrupt;
+
+        gro->num_entries = gro->max_entries = groups[g].num_entries;
+
+        for (uint32_t e = 0; e < gro->num_entries; e++)
+        {
+            const snapshot_entry_t* src = &entries[first + e];
+            playlist_entry_t* dst = &gro->entries[e];
+
+            dst->url  = SNAPSHOT_STR(src->url);
+            dst->name = SNAPSHOT_STR(src->name);
+            dst->logo = SNAPSHOT_STR(src->logo);
+            dst->id   = SNAPSHOT_STR(src->id);
+
+            if (dst->url == NULL || dst->name == NULL || dst->logo == NULL || dst->id == NULL)
+                goto corrupt;
+        }
+
+        first += groups[g].num_entries;
+    }
+
+    #undef SNAPSHOT_STR
+
+    return (uint32_t)header->num_entries;
+
+    corrupt:
+    fprintf(stderr, "\nPlaylist snapshot of '%s' is corrupt\n", source);
+    playlist_destroy(playlist);
+    return 0;
+}
+
+// bytes taken by the strings of an entry in the string table
+static uint64_t snapshot_entry_strings(const playlist_entry_t* entry)
+{
+    return strlen(entry->url) + strlen(entry->name) + strlen(entry->logo) + strlen(entry->id) + 4;
+}
+
+// offset of the string in the table, advancing 'offset' past it
+static uint64_t snapshot_offset(uint64_t* offset, const char* str)
+{
+    uint64_t start = *offset;
+    *offset += strlen(str) + 1;
+    return start;
+}
+
+// writes the playlist to a temporary file and renames it over the previous snapshot
+static int playlist_snapshot_save(const char* source, const snapshot_key_t* key, const playlist_t* playlist)
+{
+    mkdir(cache_dir, 0777); // may already exist
+
+    char path[256], temp_path[272];
+    playlist_snapshot_path(source, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+
+    FILE* fp;
+    if ((fp = fopen(temp_path, "wb")) == NULL)
+        return 0;
+
+    snapshot_header_t header = {
+        .magic = PLAYLIST_SNAPSHOT_MAGIC,
+        .version = PLAYLIST_SNAPSHOT_VERSION,
+        .key = *key,
+        .source_len = snapshot_source_len(source),
+        .num_groups = playlist->num_groups,
+        .num_entries = 0,
+        .strings_len = 0,
+    };
+
+    // strings are laid out in the same order they are written below
+    for (uint32_t g = 0; g < playlist->num_groups; g++)
+    {
+        const playlist_group_t* gro = &playlist->groups[g];
+        header.strings_len += strlen(gro->group_name) + 1;
+        header.num_entries += gro->num_entries;
+
+        for (uint32_t e = 0; e < gro->num_entries; e++)
+            header.strings_len += snapshot_entry_strings(&gro->entries[e]);
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    char source_buffer[header.source_len];
+    memset(source_buffer, 0, header.source_len);
+    strcpy(source_buffer, source);
+    ok = ok && fwrite(source_buffer, header.source_len, 1, fp) == 1;
+
+    uint64_t offset = 0;
+
+    for (uint32_t g = 0; ok && g < playlist->num_groups; g++)
+    {
+        const playlist_group_t* gro = &playlist->groups[g];
+        snapshot_group_t rec = { .num_entries = gro->num_entries, .reserved = 0 };
+
+        rec.name = snapshot_offset(&offset, gro->group_name);
+        for (uint32_t e = 0; e < gro->num_entries; e++) // skip over the strings of the entries
+            offset += snapshot_entry_strings(&gro->entries[e]);
+
+        ok = fwrite(&rec, sizeof(rec), 1, fp) == 1;
+    }
+
+    offset = 0;
+    for (uint32_t g = 0; ok && g < playlist->num_groups; g++)
+    {
+        const playlist_group_t* gro = &playlist->groups[g];
+        offset += strlen(gro->group_name) + 1;
+
+        for (uint32_t e = 0; ok && e < gro->num_entries; e++)
+        {
+            const playlist_entry_t* entry = &gro->entries[e];
+            snapshot_entry_t rec;
+
+            rec.url  = snapshot_offset(&offset, entry->url);
+            rec.name = snapshot_offset(&offset, entry->name);
+            rec.logo = snapshot_offset(&offset, entry->logo);
+            rec.id   = snapshot_offset(&offset, entry->id);
+
+            ok = fwrite(&rec, sizeof(rec), 1, fp) == 1;
+        }
+    }
+
+    for (uint32_t g = 0; ok && g < playlist->num_groups; g++)
+    {
+        const playlist_group_t* gro = &playlist->groups[g];
+        ok = fwrite(gro->group_name, strlen(gro->group_name) + 1, 1, fp) == 1;
+
+        for (uint32_t e = 0; ok && e < gro->num_entries; e++)
+        {
+            const playlist_entry_t* entry = &gro->entries[e];
+
+            ok = fwrite(entry->url,  strlen(entry->url) + 1,  1, fp) == 1
+              && fwrite(entry->name, strlen(entry->name) + 1, 1, fp) == 1
+              && fwrite(entry->logo, strlen(entry->logo) + 1, 1, fp) == 1
+              && fwrite(entry->id,   strlen(entry->id) + 1,   1, fp) == 1;
+        }
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(temp_path, path) != 0)
+    {
+        fprintf(stderr, "\nFailed to save playlist snapshot '%s': %d %s\n", path, errno, strerror(errno));
+        remove(temp_path);
+        return 0;
+    }
+
+    return 1;
+}
+
+// =====================================
+// M3U PARSER
+// =====================================
+
+const char* const http_user_agent = "Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:81.0) Gecko/20100101 Firefox/81.0";
+
+void m3u_parser_init(m3u_parser_t* parser, playlist_t* playlist)
+{
+    *parser = (m3u_parser_t) {
+        .playlist = playlist,
+        .group = UINT32_MAX,
+        .has_info = 0,
+        .total_entries = 0,
+        .head = NULL,
+        .carry = NULL,
+        .carry_len = 0,
+        .carry_max = 0,
+    };
+}
+
+static int m3u_select_group(m3u_parser_t* parser, const char* name, size_t len)
+{
+    playlist_group_t* gro;
+
+    if ((gro = playlist_find_group_n(parser->playlist, name, len)) == NULL)    // try to find group
+        if ((gro = playlist_new_group_n(parser->playlist, name, len)) == NULL) // try to create group
+            return 0; // something went wrong...
+
+    parser->group = (uint32_t)(gro - parser->playlist->groups);
+    return 1;
+}
+
+// #EXTINF:-1 tvg-id="..." tvg-logo="..." group-title="...",Channel name
+static void m3u_parse_extinf(m3u_parser_t* parser, const char* line, const char* end)
+{
+    const char* logo = "";
+    const char* id = "";
+    size_t len_logo = 0, len_id = 0;
+
+    const char* p = line;
+    while (p < end && *p != ',')
+    {
+        if (*p == ' ' || *p == '\t')
+        {
+            p++;
+            continue;
+        }
+
+        // key of the attribute (or the duration, which has no value)
+        const char* key = p;
+        while (p < end && *p != '=' && *p != ' ' && *p != ',')
+            p++;
+
+        size_t len_key = p - key;
+
+        if (p >= end || *p != '=')
+            continue;
+
+        if (++p >= end || *p != '"')
+            continue; // unquoted values are not used
+
+        // the value may contain commas, so find the closing quote first
+        const char* value = ++p;
+        const char* quote = (const char*)memchr(value, '"', end - value);
+
+        if (quote == NULL)
+            return; // bad tag
+
+        size_t len_value = strnlen(value, quote - value); // cut at a NUL, as the strings will be
+        p = quote + 1;
+
+        if (len_key == 8 && memcmp(key, "tvg-logo", 8) == 0)
+            logo = value, len_logo = len_value;
+        else if (len_key == 6 && memcmp(key, "tvg-id", 6) == 0)
+            id = value, len_id = len_value;
+        else if (len_key == 11 && memcmp(key, "group-title", 11) == 0)
+        {
+            if (!m3u_select_group(parser, value, len_value))
+                return;
+        }
+    }
+
+    if (p >= end)
+        return; // no name - bad tag
+
+    const char* name = p + 1;
+    while (name < end && (*name == ' ' || *name == '\t'))
+        name++;
+
+    parser->name = playlist_strndup(parser->playlist, name, end - name);
+    parser->logo = playlist_strndup(parser->playlist, logo, len_logo);
+    parser->id   = playlist_strndup(parser->playlist, id, len_id);
+    parser->has_info = (parser->name != NULL && parser->logo != NULL && parser->id != NULL);
+}
+
+static void m3u_parse_url(m3u_parser_t* parser, const char* line, const char* end)
+{
+    playlist_t* playlist = parser->playlist;
+
+    // entries without a group-title go to the group of the previous one
+    if (parser->group == UINT32_MAX && parser->head == NULL && !m3u_select_group(parser, "", 0))
+        return;
+
+    char* url = playlist_strndup(playlist, line, end - line);
+    if (url == NULL)
+        return;
+
+    playlist_entry_t* entry = group_append_entry((parser->group == UINT32_MAX) ? parser->head : &playlist->groups[parser->group]);
+    if (entry == NULL)
+        return;
+
+    entry->url = url;
+
+    if (parser->has_info)
+    {
+        entry->name = parser->name;
+        entry->logo = parser->logo;
+        entry->id   = parser->id;
+    }
+    else
+    {
+        // plain url without #EXTINF
+        entry->name = url;
+        entry->logo = &url[end - line]; // empty string
+        entry->id   = entry->logo;
+    }
+
+    parser->has_info = 0;
+    parser->total_entries++;
+}
+
+static void m3u_parse_line(m3u_parser_t* parser, const char* line, size_t len)
+{
+    const char* end = line + len;
+
+    // remove line breaks and trailing spaces
+    while (end > line && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+    if (end == line)
+        return; // empty line
+
+    if (line[0] != '#')
+        m3u_parse_url(parser, line, end);
+    else if (end - line > 8 && memcmp(line, "#EXTINF:", 8) == 0)
+        m3u_parse_extinf(parser, line + 8, end);
+    // else: comment or unused tag
+}
+
+// parses every complete line of the buffer and returns how many bytes were consumed
+static size_t m3u_parse_buffer(m3u_parser_t* parser, const char* buffer, size_t len)
+{
+    const char* line = buffer;
+    const char* end = buffer + len;
+    const char* eol;
+
+    while (line < end && (eol = (const char*)memchr(line, '\n', end - line)) != NULL)
+    {
+        m3u_parse_line(parser, line, eol - line);
+        line = eol + 1;
+    }
+
+    return line - buffer;
+}
+
+// accepts the playlist in chunks of any size, e.g. as they arrive from the network
+int m3u_parser_feed(m3u_parser_t* parser, const char* data, size_t len)
+{
+    if (parser->carry_len > 0)
+    {
+        // complete the line left from the previous chunk
+        const char* eol = (const char*)memchr(data, '\n', len);
+        size_t part = (eol == NULL) ? len : (size_t)(eol - data) + 1;
+
+        if (parser->carry_len + part > parser->carry_max)
+        {
+            size_t new_max = (parser->carry_len + part) * 2;
+            char* new_carry = (char*)realloc(parser->carry, new_max);
+
+            if (new_carry == NULL)
+                return 0;
+
+            parser->carry = new_carry;
+            parser->carry_max = new_max;
+        }
+
+        memcpy(parser->carry + parser->carry_len, data, part);
+        parser->carry_len += part;
+        data += part;
+        len -= part;
+
+        if (eol == NULL)
+            return 1; // still incomplete
+
+        m3u_parse_line(parser, parser->carry, parser->carry_len - 1);
+        parser->carry_len = 0;
+    }
+
+    // the bulk of the chunk is parsed in place
+    size_t used = m3u_parse_buffer(parser, data, len);
+
+    if (used < len)
+    {
+        if (len - used > parser->carry_max)
+        {
+            size_t new_max = (len - used) * 2;
+            char* new_carry = (char*)realloc(parser->carry, new_max);
+
+            if (new_carry == NULL)
+                return 0;
+
+            parser->carry = new_carry;
+            parser->carry_max = new_max;
+        }
+
+        memcpy(parser->carry, data + used, len - used);
+        parser->carry_len = len - used;
+    }
+
+    return 1;
+}
+
+// parses the last line (if it has no line break) and releases the parser
+uint32_t m3u_parser_finish(m3u_parser_t* parser)
+{
+    if (parser->carry_len > 0)
+        m3u_parse_line(parser, parser->carry, parser->carry_len);
+
+    free(parser->carry);
+    parser->carry = NULL;
+    parser->carry_len = parser->carry_max = 0;
+
+    return parser->total_entries;
+}
+
+// =====================================
+// PARALLEL PARSER
+// =====================================
+
+int m3u_parse_threads = 0;
+
+#define M3U_PARALLEL_MIN    (4*1024*1024)   // smaller files are parsed faster by one thread
+#define M3U_MAX_THREADS     32
+
+// one piece of the text, parsed into a playlist of its own
+typedef struct m3u_chunk {
+    const char* data;
+    size_t len;
+    playlist_t playlist;
+    playlist_group_t head;  // entries before the first group-title: the group is the last one of the previous chunks
+    m3u_parser_t parser;
+    pthread_t thread;
+} m3u_chunk_t;
+
+static void* m3u_chunk_parse(void* arg)
+{
+    m3u_chunk_t* chunk = (m3u_chunk_t*)arg;
+
+    // every chunk but the last ends with a line break
+    size_t used = m3u_parse_buffer(&chunk->parser, chunk->data, chunk->len);
+    m3u_parse_line(&chunk->parser, chunk->data + used, chunk->len - used);
+
+    return NULL;
+}
+
+// the first #EXTINF line at or after 'pos' - so no entry is split between chunks
+static size_t m3u_next_extinf(const char* data, size_t len, size_t pos)
+{
+    while (pos < len)
+    {
+        const char* eol = (const char*)memchr(data + pos, '\n', len - pos);
+        if (eol == NULL)
+            return len;
+
+        pos = eol - data + 1;
+
+        if (len - pos > 8 && memcmp(data + pos, "#EXTINF:", 8) == 0)
+            return pos;
+    }
+
+    return len;
+}
+
+static int m3u_append_entries(playlist_group_t* g, const playlist_entry_t* entries, uint32_t count)
+{
+    if (g->num_entries + count > g->max_entries)
+    {
+        uint32_t new_max = (g->num_entries + count) * 2;
+        playlist_entry_t* new_entries = (playlist_entry_t*)realloc(g->entries, new_max * sizeof(playlist_entry_t));
+
+        if (new_entries == NULL)
+            return 0;
+
+        g->entries = new_entries;
+        g->max_entries = new_max;
+    }
+
+    memcpy(&g->entries[g->num_entries], entries, count * sizeof(playlist_entry_t));
+    g->num_entries += count;
+
+    return 1;
+}
+
+// moves the chunk into the playlist, after the previous chunks: 'group' is the group of the last entry so far
+static int m3u_chunk_merge(m3u_chunk_t* chunk, playlist_t* playlist, uint32_t* group)
+{
+    playlist_t* local = &chunk->playlist;
+
+    if (chunk->head.num_entries > 0)
+    {
+        if (*group == UINT32_MAX)
+        {
+            playlist_group_t* gro;
+
+            if ((gro = playlist_find_group_n(playlist, "", 0)) == NULL && (gro = playlist_new_group_n(playlist, "", 0)) == NULL)
+                return 0;
+
+            *group = (uint32_t)(gro - playlist->groups);
+        }
+
+        if (!m3u_append_entries(&playlist->groups[*group], chunk->head.entries, chunk->head.num_entries))
+            return 0;
+    }
+
+    // groups are visited in the order they first appear, so the merged playlist keeps that order too
+    for (uint32_t g = 0; g < local->num_groups; g++)
+    {
+        playlist_group_t* src = &local->groups[g];
+        size_t len = strlen(src->group_name);
+        playlist_group_t* dst;
+
+        // the name stays in the blocks of the chunk, which are handed over below
+        if ((dst = playlist_find_group_n(playlist, src->group_name, len)) == NULL && (dst = playlist_add_group(playlist, src->group_name, len)) == NULL)
+            return 0;
+
+        if (!m3u_append_entries(dst, src->entries, src->num_entries))
+            return 0;
+
+        if (chunk->parser.group == g)
+            *group = (uint32_t)(dst - playlist->groups);
+    }
+
+    // hand the strings over: the blocks are linked after the one being filled
+    playlist_block_t* first = local->blocks;
+    if (first != NULL)
+    {
+        playlist_block_t* last = first;
+        while (last->next != NULL)
+            last = last->next;
+
+        if (playlist->blocks == NULL)
+            playlist->blocks = first;
+        else
+        {
+            last->next = playlist->blocks->next;
+            playlist->blocks->next = first;
+        }
+
+        local->blocks = NULL;
+    }
+
+    return 1;
+}
+
+// threads really used for 'num_threads' (0: one per core)
+static int m3u_resolve_threads(int num_threads)
+{
+    if (num_threads <= 0)
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (num_threads > M3U_MAX_THREADS)
+        num_threads = M3U_MAX_THREADS;
+
+    return (num_threads < 1) ? 1 : num_threads;
+}
+
+// parses text held in memory on 'num_threads' threads (0: one per core) - the result is the same as parsing it in one pass
+uint32_t m3u_parse_parallel(playlist_t* playlist, const char* data, size_t len, int num_threads)
+{
+    num_threads = m3u_resolve_threads(num_threads);
+
+    // a single chunk would only add a copy of the entries when merged
+    if (num_threads == 1)
+    {
+        m3u_parser_t parser;
+        m3u_parser_init(&parser, playlist);
+
+        size_t used = m3u_parse_buffer(&parser, data, len);
+        m3u_parse_line(&parser, data + used, len - used);
+
+        return m3u_parser_finish(&parser);
+    }
+
+    m3u_chunk_t* chunks = (m3u_chunk_t*)calloc(num_threads, sizeof(m3u_chunk_t));
+    if (chunks == NULL)
+        return 0;
+
+    // split in about equal parts, each starting at an #EXTINF line
+    size_t start = 0;
+    for (int c = 0; c < num_threads; c++)
+    {
+        size_t end = (c == num_threads - 1) ? len : m3u_next_extinf(data, len, (len / num_threads) * (c + 1));
+        if (end < start)
+            end = start;
+
+        m3u_chunk_t* chunk = &chunks[c];
+        chunk->data = data + start;
+        chunk->len = end - start;
+
+        playlist_init(&chunk->playlist);
+        m3u_parser_init(&chunk->parser, &chunk->playlist);
+
+        // the first chunk has nothing before it to inherit a group from
+        if (c > 0)
+            chunk->parser.head = &chunk->head;
+
+        start = end;
+    }
+
+    // the first chunk is parsed by this thread
+    for (int c = 1; c < num_threads; c++)
+        if (pthread_create(&chunks[c].thread, NULL, m3u_chunk_parse, &chunks[c]) != 0)
+        {
+            chunks[c].thread = pthread_self();
+            m3u_chunk_parse(&chunks[c]);
+        }
+
+    m3u_chunk_parse(&chunks[0]);
+
+    uint32_t total_entries = 0;
+    uint32_t group = UINT32_MAX;
+    int ok = 1;
+
+    for (int c = 0; c < num_threads; c++)
+    {
+        m3u_chunk_t* chunk = &chunks[c];
+
+        if (c > 0 && !pthread_equal(chunk->thread, pthread_self()))
+            pthread_join(chunk->thread, NULL);
+
+        if (ok && (ok = m3u_chunk_merge(chunk, playlist, &group)))
+            total_entries += chunk->parser.total_entries;
+
+        free(chunk->head.entries);
+        m3u_parser_finish(&chunk->parser);
+        playlist_destroy(&chunk->playlist);
+    }
+
+    free(chunks);
+
+    if (!ok)
+    {
+        fprintf(stderr, "\nOut of memory merging the parsed playlist\n");
+        return 0;
+    }
+
+    return total_entries;
+}
+
+int playlist_is_url(const char* source)
+{
+    return strncmp(source, "http://", 7) == 0 || strncmp(source, "https://", 8) == 0;
+}
+
+static size_t m3u_curl_write(char* data, size_t size, size_t nmemb, void* user)
+{
+    // each chunk is parsed as soon as it arrives
+    if (!m3u_parser_feed((m3u_parser_t*)user, data, size * nmemb))
+        return 0; // abort the transfer
+
+    return size * nmemb;
+}
+
+static size_t m3u_curl_header(char* data, size_t size, size_t nmemb, void* user)
+{
+    snapshot_key_t* key = (snapshot_key_t*)user;
+    size_t len = size * nmemb;
+
+    if (len > 5 && strncasecmp(data, "ETag:", 5) == 0)
+    {
+        const char* value = data + 5;
+        const char* end = data + len;
+
+        while (value < end && (*value == ' ' || *value == '\t'))
+            value++;
+        while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' '))
+            end--;
+
+        if ((size_t)(end - value) < sizeof(key->etag))
+        {
+            memcpy(key->etag, value, end - value);
+            key->etag[end - value] = '\0';
+        }
+    }
+
+    return len;
+}
+
+// prepares a transfer which feeds the playlist to the parser as it downloads
+void m3u_download_setup(m3u_download_t* download, CURL* curl, const char* url, playlist_t* playlist)
+{
+    m3u_parser_init(&download->parser, playlist);
+    memset(&download->received, 0, sizeof(snapshot_key_t));
+    download->headers = NULL;
+
+    // the server answers 304 if the snapshot is still current
+    if (playlist_snapshot_key(url, &download->sent) && download->sent.etag[0] != '\0')
+    {
+        char header[sizeof(download->sent.etag) + 32];
+        snprintf(header, sizeof(header), "If-None-Match: %s", download->sent.etag);
+        download->headers = curl_slist_append(NULL, header);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, http_user_agent);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ""); // gzip, deflate or whatever curl supports
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, download->headers);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, m3u_curl_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &download->received);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, m3u_curl_write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download->parser);
+}
+
+// completes the playlist once the transfer is over and refreshes the snapshot
+uint32_t m3u_download_finish(m3u_download_t* download, CURL* curl, const char* url, CURLcode result)
+{
+    playlist_t* playlist = download->parser.playlist;
+    uint32_t total_entries = m3u_parser_finish(&download->parser);
+
+    curl_slist_free_all(download->headers);
+    download->headers = NULL;
+
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+
+    if (result != CURLE_OK)
+        fprintf(stderr, "\nCurl failed to download playlist '%s': %s\n", url, curl_easy_strerror(result));
+    else if (status == 304)
+    {
+        // not modified - nothing was parsed, use the snapshot
+        playlist_destroy(playlist);
+        return playlist_snapshot_load(url, NULL, playlist);
+    }
+    else if (total_entries > 0 && download->received.etag[0] != '\0')
+        playlist_snapshot_save(url, &download->received, playlist);
+
+    return total_entries;
+}
+
+uint32_t read_playlist_url(const char* url, playlist_t* playlist)
+{
+    CURL* curl = curl_easy_init();
+    if (curl == NULL)
+        return 0;
+
+    m3u_download_t download;
+    m3u_download_setup(&download, curl, url, playlist);
+
+    CURLcode result = curl_easy_perform(curl);
+    uint32_t total_entries = m3u_download_finish(&download, curl, url, result);
+
+    curl_easy_cleanup(curl);
+    return total_entries;
+}
+
+uint32_t read_playlist(const char* filename, playlist_t* playlist)
+{
+    // sanity check
+    if (filename == NULL || playlist == NULL)
+        return 0;
+    else
+        playlist_init(playlist); // fresh start
+
+    if (playlist_is_url(filename))
+        return read_playlist_url(filename, playlist);
+
+    // open the file
+    int fd;
+    if ((fd = open(filename, O_RDONLY)) == -1)
+        return 0;
+
+    m3u_parser_t parser;
+    m3u_parser_init(&parser, playlist);
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    snapshot_key_t key = { 0 };
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        key.size = st.st_size;
+        key.mtime = st.st_mtime;
+
+        // skip parsing if the file did not change since the last run
+        uint32_t total_entries = playlist_snapshot_load(filename, &key, playlist);
+        if (total_entries > 0)
+        {
+            close(fd);
+            return total_entries;
+        }
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (map != MAP_FAILED)
+    {
+        if (st.st_size >= M3U_PARALLEL_MIN && m3u_resolve_threads(m3u_parse_threads) > 1)
+        {
+            // big lists are split among the cores
+            parser.total_entries = m3u_parse_parallel(playlist, (const char*)map, st.st_size, m3u_parse_threads);
+        }
+        else
+        {
+            // whole file is parsed in place in a single pass
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+            size_t used = m3u_parse_buffer(&parser, (const char*)map, st.st_size);
+            m3u_parse_line(&parser, (const char*)map + used, st.st_size - used);
+        }
+
+        munmap(map, st.st_size);
+    }
+    else
+    {
+        // cannot be mapped (e.g. a pipe) - read it in chunks
+        char buffer[64*1024];
+        ssize_t read_len;
+
+        while ((read_len = read(fd, buffer, sizeof(buffer))) > 0)
+            m3u_parser_feed(&parser, buffer, read_len);
+    }
+
+    close(fd);
+
+    uint32_t total_entries = m3u_parser_finish(&parser);
+
+    if (total_entries > 0 && key.size > 0)
+        playlist_snapshot_save(filename, &key, playlist);
+
+    return total_entries;
+}
+
+// =====================================
+// SEARCH INDEX
+// =====================================
+
+// finds channels by any part of their name: every trigram of the lowercased names lists the entries
+// having it, so a query only needs to check the entries listed for its rarest trigram
+#define SEARCH_BUCKETS      (1 << 16)   // trigrams are hashed into this many lists
+#define SEARCH_MAX_QUERY    256
+
+void search_index_init(search_index_t* index)
+{
+    memset(index, 0, sizeof(search_index_t));
+}
+
+void search_index_destroy(search_index_t* index)
+{
+    free(index->refs);
+    free(index->name_offset);
+    free(index->names);
+    free(index->bucket_start);
+    free(index->postings);
+
+    search_index_init(index);
+}
+
+static inline uint32_t search_trigram(const char* str)
+{
+    uint32_t trigram = ((uint32_t)(uint8_t)str[0] << 16) | ((uint32_t)(uint8_t)str[1] << 8) | (uint8_t)str[2];
+    return (trigram * 2654435761u) >> 16; // SEARCH_BUCKETS
+}
+
+// ASCII only: accented letters must be typed as in the playlist
+static size_t search_lower(char* dst, const char* src, size_t max)
+{
+    size_t len = 0;
+
+    while (src[len] != '\0' && len + 1 < max)
+    {
+        dst[len] = tolower((unsigned char)src[len]);
+        len++;
+    }
+
+    dst[len] = '\0';
+    return len;
+}
+
+// counts (when 'postings' is NULL) or stores the postings of every ref, each ref once per bucket
+static void search_index_post(search_index_t* index, uint32_t* cursor, uint32_t* last, uint32_t* postings)
+{
+    for (uint32_t b = 0; b < SEARCH_BUCKETS; b++)
+        last[b] = UINT32_MAX;
+
+    for (uint32_t r = 0; r < index->num_refs; r++)
+        for (const char* name = index->names + index->name_offset[r]; name[0] && name[1] && name[2]; name++)
+        {
+            uint32_t b = search_trigram(name);
+
+            if (last[b] == r)
+                continue;
+
+            last[b] = r;
+
+            if (postings == NULL)
+                cursor[b + 1]++;
+            else
+                postings[cursor[b]++] = r;
+        }
+}
+
+// rebuilds the index of the whole playlist - returns 0 on error (the index is left empty)
+int search_index_build(search_index_t* index, const playlist_t* playlist)
+{
+    search_index_destroy(index);
+
+    size_t names_len = 0;
+
+    for (uint32_t g = 0; g < playlist->num_groups; g++)
+        for (uint32_t e = 0; e < playlist->groups[g].num_entries; e++)
+        {
+            names_len += strlen(playlist->groups[g].entries[e].name) + 1;
+            index->num_refs++;
+        }
+
+    if (names_len > UINT32_MAX)
+    {
+        fprintf(stderr, "\nToo many channels to index\n");
+        index->num_refs = 0;
+        return 0;
+    }
+
+    index->refs = (playlist_ref_t*)malloc((index->num_refs + 1) * sizeof(playlist_ref_t));
+    index->name_offset = (uint32_t*)malloc((index->num_refs + 1) * sizeof(uint32_t));
+    index->names = (char*)malloc(names_len + 1);
+    index->bucket_start = (uint32_t*)calloc(SEARCH_BUCKETS + 1, sizeof(uint32_t));
+
+    uint32_t* cursor = (uint32_t*)malloc(SEARCH_BUCKETS * sizeof(uint32_t));
+    uint32_t* last = (uint32_t*)malloc(SEARCH_BUCKETS * sizeof(uint32_t));
+
+    if (index->refs == NULL || index->name_offset == NULL || index->names == NULL || index->bucket_start == NULL || cursor == NULL || last == NULL)
+    {
+        fprintf(stderr, "\nOut of memory building the search index\n");
+        free(cursor);
+        free(last);
+        search_index_destroy(index);
+        return 0;
+    }
+
+    // lowercased copy of the names
+    uint32_t r = 0;
+    size_t offset = 0;
+
+    for (uint32_t g = 0; g < playlist->num_groups; g++)
+        for (uint32_t e = 0; e < playlist->groups[g].num_entries; e++, r++)
+        {
+            index->refs[r] = (playlist_ref_t) { .group = g, .entry = e };
+            index->name_offset[r] = offset;
+            offset += search_lower(index->names + offset, playlist->groups[g].entries[e].name, SIZE_MAX) + 1;
+        }
+
+    // count the postings of each bucket, then place them
+    search_index_post(index, index->bucket_start, last, NULL);
+
+    for (uint32_t b = 0; b < SEARCH_BUCKETS; b++)
+        index->bucket_start[b + 1] += index->bucket_start[b];
+
+    index->postings = (uint32_t*)malloc((index->bucket_start[SEARCH_BUCKETS] + 1) * sizeof(uint32_t));
+
+    if (index->postings != NULL)
+    {
+        memcpy(cursor, index->bucket_start, SEARCH_BUCKETS * sizeof(uint32_t));
+        search_index_post(index, cursor, last, index->postings);
+    }
+
+    free(cursor);
+    free(last);
+
+    if (index->postings == NULL)
+    {
+        fprintf(stderr, "\nOut of memory building the search index\n");
+        search_index_destroy(index);
+        return 0;
+    }
+
+    return 1;
+}
+
+// stores up to 'max_results' entries whose name contains the query, in playlist order - returns how many
+uint32_t search_index_find(const search_index_t* index, const char* query, playlist_ref_t* results, uint32_t max_results)
+{
+    char lower[SEARCH_MAX_QUERY];
+    size_t len = search_lower(lower, query, sizeof(lower));
+    uint32_t num_results = 0;
+
+    if (len == 0 || index->postings == NULL)
+        return 0;
+
+    // too short for a trigram: check every name
+    if (len < 3)
+    {
+        for (uint32_t r = 0; r < index->num_refs && num_results < max_results; r++)
+            if (strstr(index->names + index->name_offset[r], lower) != NULL)
+                results[num_results++] = index->refs[r];
+
+        return num_results;
+    }
+
+    // the names having the query have all its trigrams: the shortest list is enough to find them
+    uint32_t best = search_trigram(lower);
+
+    for (size_t i = 1; i + 2 < len; i++)
+    {
+        uint32_t b = search_trigram(lower + i);
+
+        if (index->bucket_start[b + 1] - index->bucket_start[b] < index->bucket_start[best + 1] - index->bucket_start[best])
+            best = b;
+    }
+
+    for (uint32_t p = index->bucket_start[best]; p < index->bucket_start[best + 1] && num_results < max_results; p++)
+    {
+        uint32_t r = index->postings[p];
+
+        if (strstr(index->names + index->name_offset[r], lower) != NULL)
+            results[num_results++] = index->refs[r];
+    }
+
+    return num_results;
+}
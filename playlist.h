@@ -0,0 +1,192 @@
+/* ===================================================================================  //
+//    This program is free software: you can redistribute it and/or modify              //
+//    it under the terms of the GNU General Public License as published by              //
+//    the Free Software Foundation, either version 3 of the License, or                 //
+//    (at your option) any later version.                                               //
+//                                                                                      //
+//    This program is distributed in the hope that it will be useful,                   //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                    //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                     //
+//    GNU General Public License for more details.                                      //
+//                                                                                      //
+//    You should have received a copy of the GNU General Public License                 //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//    Copyright: Luiz Gustavo Pfitscher e Feldmann, 2020                                //
+// ===================================================================================  */
+
+#ifndef _PLAYLIST_H_
+#define _PLAYLIST_H_
+
+// playlist storage, M3U parser, snapshots and search index - no GUI dependencies,
+// so they can be built on their own (see tools/m3u_bench.c)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <curl/curl.h>  // sudo apt install libcurl4-openssl-dev
+
+// =====================================
+// PLAYLIST
+// =====================================
+
+typedef struct playlist_entry {
+    char* url;
+    char* name;
+    char* logo;
+    char* id;   // tvg-id
+    int16_t status;         // last probe: HTTP status, -1 if unreachable, 0 if not probed yet (or PLAYLIST_ENTRY_REMOVED)
+    uint16_t latency_ms;    // time to the first byte of the last probe
+} playlist_entry_t;
+
+#define PLAYLIST_ENTRY_REMOVED (-2) // status of entries gone from the source since it was loaded
+
+typedef struct playlist_group {
+    char* group_name;
+    uint32_t name_hash;         // hash of 'group_name' used by the group index
+    uint32_t num_entries;
+    uint32_t max_entries;       // allocated capacity of 'entries'
+    playlist_entry_t* entries;
+} playlist_group_t;
+
+typedef struct playlist_block {
+    struct playlist_block* next;
+    size_t used;
+    size_t size;
+    char data[];
+} playlist_block_t;
+
+typedef struct playlist {
+    uint32_t num_groups;
+    uint32_t max_groups;        // allocated capacity of 'groups'
+    playlist_group_t* groups;
+    uint32_t* group_index;      // open addressing hash table of (group number + 1) - zero means empty slot
+    uint32_t index_size;        // number of slots in 'group_index' - always a power of two
+    playlist_block_t* blocks;   // string storage - the head is the block being filled
+    playlist_group_t alternates;// not listed: the same channels (by tvg-id) from other sources, see playlist_merge_add
+    void* map;                  // snapshot the strings point into - NULL if parsed from text
+    size_t map_len;
+} playlist_t;
+
+// identifies an entry by position, which unlike pointers stays valid while the playlist grows
+typedef struct playlist_ref {
+    uint32_t group;
+    uint32_t entry;
+} playlist_ref_t;
+
+void playlist_init(playlist_t* playlist);
+uint32_t playlist_hash(const char* str, size_t len);
+char* playlist_strndup(playlist_t* playlist, const char* str, size_t len);
+char* playlist_strdup(playlist_t* playlist, const char* str);
+void* playlist_grow(void* array, size_t elem_size, uint32_t count, uint32_t* capacity);
+playlist_group_t* playlist_find_group(playlist_t* playlist, const char* group_name);
+playlist_group_t* playlist_new_group_n(playlist_t* playlist, const char* group_name, size_t len);
+playlist_group_t* playlist_new_group(playlist_t* playlist, const char* group_name);
+playlist_entry_t* group_new_entry(playlist_t* playlist, playlist_group_t* g, const char* name, const char* logo, const char* id, const char* url);
+playlist_entry_t* playlist_new_entry(playlist_t* playlist, const char* group_name, const char* name, const char* logo, const char* id, const char* url);
+void playlist_destroy(playlist_t* playlist);
+void playlist_print(playlist_t* playlist);
+
+// =====================================
+// PLAYLIST UPDATE
+// =====================================
+
+typedef struct playlist_update_stats {
+    uint32_t changed;   // url or logo replaced
+    uint32_t added;
+    uint32_t removed;   // marked PLAYLIST_ENTRY_REMOVED
+} playlist_update_stats_t;
+
+// set of strings stored elsewhere (e.g. in a playlist) - each key carries a tag
+typedef struct playlist_key_set {
+    uint32_t size;      // power of two
+    uint32_t count;
+    const char** keys;
+    uint32_t* tags;
+} playlist_key_set_t;
+
+// state of the merge of several sources into one playlist
+typedef struct playlist_merge {
+    playlist_key_set_t urls;
+    playlist_key_set_t ids;     // tagged with the source which added the tvg-id
+    uint32_t duplicates;        // entries dropped
+    uint32_t alternates;        // entries moved to the alternates of the playlist
+} playlist_merge_t;
+
+int playlist_update(playlist_t* playlist, const playlist_t* fresh, playlist_update_stats_t* stats);
+void playlist_merge_init(playlist_merge_t* merge);
+void playlist_merge_destroy(playlist_merge_t* merge);
+uint32_t playlist_merge_add(playlist_merge_t* merge, playlist_t* dst, const playlist_t* src, uint32_t source);
+
+// =====================================
+// PLAYLIST SNAPSHOT
+// =====================================
+
+extern const char cache_dir[]; // also holds the logos
+
+// identifies the version of the source the snapshot was made from
+typedef struct snapshot_key {
+    int64_t size;       // local files: size and modification time
+    int64_t mtime;
+    char etag[128];     // remote playlists: ETag sent by the server
+} snapshot_key_t;
+
+// =====================================
+// M3U PARSER
+// =====================================
+
+extern const char* const http_user_agent;
+
+// state carried from one line to the next, so the playlist may be parsed piece by piece
+typedef struct m3u_parser {
+    playlist_t* playlist;
+    uint32_t group;         // group of the next entry - UINT32_MAX if none yet
+    uint8_t has_info;       // an #EXTINF line is waiting for its url
+    char* name;             // fields of that #EXTINF line - already copied into the playlist
+    char* logo;
+    char* id;
+    uint32_t total_entries;
+    playlist_group_t* head; // parallel parse: takes the entries before the first group-title of the chunk
+    char* carry;            // incomplete line left at the end of the previous chunk
+    size_t carry_len;
+    size_t carry_max;
+} m3u_parser_t;
+
+// download of a remote playlist, revalidated against its snapshot with the ETag
+typedef struct m3u_download {
+    m3u_parser_t parser;
+    snapshot_key_t sent;        // key of the snapshot we have
+    snapshot_key_t received;    // key of the playlist being downloaded
+    struct curl_slist* headers;
+} m3u_download_t;
+
+void m3u_parser_init(m3u_parser_t* parser, playlist_t* playlist);
+int m3u_parser_feed(m3u_parser_t* parser, const char* data, size_t len);
+uint32_t m3u_parser_finish(m3u_parser_t* parser);
+
+extern int m3u_parse_threads; // threads for big local playlists - 0: one per core, 1: never in parallel
+uint32_t m3u_parse_parallel(playlist_t* playlist, const char* data, size_t len, int num_threads);
+int playlist_is_url(const char* source);
+void m3u_download_setup(m3u_download_t* download, CURL* curl, const char* url, playlist_t* playlist);
+uint32_t m3u_download_finish(m3u_download_t* download, CURL* curl, const char* url, CURLcode result);
+uint32_t read_playlist_url(const char* url, playlist_t* playlist);
+uint32_t read_playlist(const char* filename, playlist_t* playlist);
+
+// =====================================
+// SEARCH INDEX
+// =====================================
+
+typedef struct search_index {
+    uint32_t num_refs;
+    playlist_ref_t* refs;       // every entry of the playlist, in order
+    uint32_t* name_offset;      // lowercased name of each ref in 'names'
+    char* names;
+    uint32_t* bucket_start;     // bucket b lists postings[bucket_start[b]] ... postings[bucket_start[b + 1] - 1]
+    uint32_t* postings;         // indices in 'refs', ascending in each bucket
+} search_index_t;
+
+void search_index_init(search_index_t* index);
+void search_index_destroy(search_index_t* index);
+int search_index_build(search_index_t* index, const playlist_t* playlist);
+uint32_t search_index_find(const search_index_t* index, const char* query, playlist_ref_t* results, uint32_t max_results);
+
+#endif // _PLAYLIST_H_
@@ -0,0 +1,264 @@
+/* ===================================================================================  //
+//    This program is free software: you can redistribute it and/or modify              //
+//    it under the terms of the GNU General Public License as published by              //
+//    the Free Software Foundation, either version 3 of the License, or                 //
+//    (at your option) any later version.                                               //
+//                                                                                      //
+//    This program is distributed in the hope that it will be useful,                   //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                    //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                     //
+//    GNU General Public License for more details.                                      //
+//                                                                                      //
+//    You should have received a copy of the GNU General Public License                 //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//    Copyright: Luiz Gustavo Pfitscher e Feldmann, 2020                                //
+// ===================================================================================  */
+
+// measures the playlist code without the GUI: synthetic playlists of several sizes and layouts
+// are parsed in memory, each case in a process of its own so the peak RSS is its own
+//
+// usage: m3u_bench [entries...]    (default: 1000 10000 100000 1000000)
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../playlist.h"
+
+// =====================================
+// ALLOCATION COUNTERS
+// =====================================
+
+// linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see build.sh)
+static uint64_t num_allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    num_allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    num_allocs++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    num_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+// =====================================
+// SYNTHETIC PLAYLISTS
+// =====================================
+
+typedef enum layout {
+    LAYOUT_PROVIDER,    // tvg-id, tvg-name, tvg-logo, group-title - the usual
+    LAYOUT_GROUP_FIRST, // group-title first, no tvg-name
+    LAYOUT_MINIMAL,     // group-title only, CRLF line breaks
+    LAYOUT_COMMAS,      // commas inside the attributes and names
+    NUM_LAYOUTS
+} layout_t;
+
+static const char* layout_names[] = { "provider", "group-first", "minimal-crlf", "commas" };
+
+typedef struct buffer {
+    char* data;
+    size_t len;
+    size_t max;
+} buffer_t;
+
+static void buffer_printf(buffer_t* buf, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void buffer_printf(buffer_t* buf, const char* format, ...)
+{
+    va_list args;
+
+    for (;;)
+    {
+        va_start(args, format);
+        int n = vsnprintf(buf->data + buf->len, buf->max - buf->len, format, args);
+        va_end(args);
+
+        if (n >= 0 && buf->len + n < buf->max)
+        {
+            buf->len += n;
+            return;
+        }
+
+        buf->max = (buf->max == 0) ? 1 << 20 : buf->max * 2;
+        if ((buf->data = (char*)realloc(buf->data, buf->max)) == NULL)
+        {
+            fprintf(stderr, "\nOut of memory generating the playlist\n");
+            exit(1);
+        }
+    }
+}
+
+static void generate(buffer_t* buf, uint32_t num_entries, uint32_t num_groups, layout_t layout)
+{
+    uint32_t seed = 2463534242u;
+
+    buf->len = 0;
+    buffer_printf(buf, "#EXTM3U\n");
+
+    for (uint32_t e = 0; e < num_entries; e++)
+    {
+        // xorshift: groups are not in order, as in real playlists
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        uint32_t g = seed % num_groups;
+
+        switch (layout)
+        {
+            case LAYOUT_PROVIDER:
+                buffer_printf(buf, "#EXTINF:-1 tvg-id=\"ch%u.id\" tvg-name=\"Channel %u\" tvg-logo=\"http://logos.example.com/%u.png\" group-title=\"Group %u\",Channel %u HD\n"
+                                   "http://stream.example.com:8080/live/user/pass/%u.ts\n", e, e, e % 5000, g, e, e);
+            break;
+
+            case LAYOUT_GROUP_FIRST:
+                buffer_printf(buf, "#EXTINF:-1 group-title=\"Group %u\" tvg-logo=\"http://logos.example.com/%u.png\" tvg-id=\"ch%u.id\",Channel %u\n"
+                                   "http://stream.example.com/%u.m3u8\n", g, e % 5000, e, e, e);
+            break;
+
+            case LAYOUT_MINIMAL:
+                buffer_printf(buf, "#EXTINF:-1 group-title=\"Group %u\",Channel %u\r\nhttp://10.0.0.1/%u\r\n", g, e, e);
+            break;
+
+            default:
+                buffer_printf(buf, "#EXTINF:-1 tvg-id=\"ch%u.id\" tvg-logo=\"http://logos.example.com/a,b/%u.png\" group-title=\"Group %u, Extra\",Channel, number %u\n"
+                                   "http://stream.example.com/live/%u.ts?a=1,b=2\n", e, e % 5000, g, e, e);
+            break;
+        }
+    }
+}
+
+// =====================================
+// MEASURES
+// =====================================
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the text arrives in chunks, as from the network
+#define CHUNK_SIZE (64 * 1024)
+
+static void run_case(uint32_t num_entries, uint32_t num_groups, layout_t layout)
+{
+    buffer_t buf = { 0 };
+    generate(&buf, num_entries, num_groups, layout);
+
+    playlist_t playlist;
+    m3u_parser_t parser;
+
+    uint64_t allocs_before = num_allocs;
+    double start = now();
+
+    playlist_init(&playlist);
+    m3u_parser_init(&parser, &playlist);
+
+    for (size_t offset = 0; offset < buf.len; offset += CHUNK_SIZE)
+        m3u_parser_feed(&parser, buf.data + offset, (buf.len - offset < CHUNK_SIZE) ? buf.len - offset : CHUNK_SIZE);
+
+    uint32_t parsed = m3u_parser_finish(&parser);
+
+    double parse_time = now() - start;
+    uint64_t parse_allocs = num_allocs - allocs_before;
+
+    // the same text split among the cores
+    playlist_t parallel;
+    playlist_init(&parallel);
+
+    start = now();
+    m3u_parse_parallel(&parallel, buf.data, buf.len, 0);
+    double parallel_time = now() - start;
+
+    playlist_destroy(&parallel);
+
+    // the structures built on top of the playlist
+    search_index_t index;
+    search_index_init(&index);
+
+    start = now();
+    search_index_build(&index, &playlist);
+    double index_time = now() - start;
+
+    playlist_update_stats_t stats;
+    start = now();
+    playlist_update(&playlist, &playlist, &stats);
+    double update_time = now() - start;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%9u %7u %-13s %9u %8.1f %9.0f %10.0f %10lu %9.1f %9.1f %9.1f %9.1f\n",
+           num_entries, num_groups, layout_names[layout], parsed,
+           buf.len / parse_time / 1e6, parsed / parse_time / 1e3,
+           usage.ru_maxrss / 1024.0, (unsigned long)parse_allocs,
+           parse_time * 1e3, parallel_time * 1e3, index_time * 1e3, update_time * 1e3);
+
+    search_index_destroy(&index);
+    playlist_destroy(&playlist);
+    free(buf.data);
+}
+
+int main(int argc, char** argv)
+{
+    static const uint32_t default_sizes[] = { 1000, 10000, 100000, 1000000 };
+    uint32_t sizes[32];
+    int num_sizes = 0;
+
+    for (int a = 1; a < argc && num_sizes < 32; a++)
+        sizes[num_sizes++] = strtoul(argv[a], NULL, 10);
+
+    if (num_sizes == 0)
+        for (num_sizes = 0; num_sizes < 4; num_sizes++)
+            sizes[num_sizes] = default_sizes[num_sizes];
+
+    printf("%9s %7s %-13s %9s %8s %9s %10s %10s %9s %9s %9s %9s\n",
+           "entries", "groups", "layout", "parsed", "MB/s", "k ent/s", "peak MB", "allocs", "parse ms", "par ms", "index ms", "diff ms");
+
+    for (int s = 0; s < num_sizes; s++)
+    {
+        uint32_t group_counts[] = { 10, 1000, sizes[s] / 10 + 1 };
+
+        for (int g = 0; g < 3; g++)
+            for (int layout = 0; layout < NUM_LAYOUTS; layout++)
+            {
+                fflush(stdout);
+
+                // in a child process: the peak RSS reported is that of this case alone
+                pid_t pid = fork();
+
+                if (pid == 0)
+                {
+                    run_case(sizes[s], group_counts[g], (layout_t)layout);
+                    fflush(stdout);
+                    _exit(0);
+                }
+
+                if (pid > 0)
+                    waitpid(pid, NULL, 0);
+            }
+    }
+
+    return 0;
+}
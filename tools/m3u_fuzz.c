@@ -0,0 +1,104 @@
+/* ===================================================================================  //
+//    This program is free software: you can redistribute it and/or modify              //
+//    it under the terms of the GNU General Public License as published by              //
+//    the Free Software Foundation, either version 3 of the License, or                 //
+//    (at your option) any later version.                                               //
+//                                                                                      //
+//    This program is distributed in the hope that it will be useful,                   //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                    //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                     //
+//    GNU General Public License for more details.                                      //
+//                                                                                      //
+//    You should have received a copy of the GNU General Public License                 //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//    Copyright: Luiz Gustavo Pfitscher e Feldmann, 2020                                //
+// ===================================================================================  */
+
+// libFuzzer target for the M3U parser, e.g. malformed #EXTINF lines (see build.sh)
+// the first byte chooses the chunk size, so lines split across chunks are exercised too
+//
+// built with -DM3U_FUZZ_STANDALONE it instead parses the files given, to replay a corpus without libFuzzer
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../playlist.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t len)
+{
+    if (len == 0)
+        return 0;
+
+    size_t chunk = 1 + data[0] * 31;
+    data++;
+    len--;
+
+    playlist_t playlist;
+    m3u_parser_t parser;
+
+    playlist_init(&playlist);
+    m3u_parser_init(&parser, &playlist);
+
+    for (size_t offset = 0; offset < len; offset += chunk)
+        m3u_parser_feed(&parser, (const char*)data + offset, (len - offset < chunk) ? len - offset : chunk);
+
+    uint32_t total_entries = m3u_parser_finish(&parser);
+
+    // every entry must be complete and the group index must find every group
+    uint32_t counted = 0;
+
+    for (uint32_t g = 0; g < playlist.num_groups; g++)
+    {
+        playlist_group_t* group = &playlist.groups[g];
+
+        if (playlist_find_group(&playlist, group->group_name) != group)
+            abort();
+
+        for (uint32_t e = 0; e < group->num_entries; e++, counted++)
+        {
+            playlist_entry_t* entry = &group->entries[e];
+
+            if (entry->url == NULL || entry->name == NULL || entry->logo == NULL || entry->id == NULL)
+                abort();
+
+            if (strchr(entry->url, '\n') != NULL || strchr(entry->name, '\n') != NULL)
+                abort();
+        }
+    }
+
+    if (counted != total_entries)
+        abort();
+
+    playlist_destroy(&playlist);
+    return 0;
+}
+
+#ifdef M3U_FUZZ_STANDALONE
+int main(int argc, char** argv)
+{
+    for (int a = 1; a < argc; a++)
+    {
+        FILE* fp = fopen(argv[a], "rb");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "\nCannot open %s\n", argv[a]);
+            continue;
+        }
+
+        fseek(fp, 0, SEEK_END);
+        long len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        uint8_t* data = (uint8_t*)malloc(len > 0 ? len : 1);
+        if (data != NULL && fread(data, 1, len, fp) == (size_t)len)
+            LLVMFuzzerTestOneInput(data, len);
+
+        free(data);
+        fclose(fp);
+    }
+
+    return 0;
+}
+#endif